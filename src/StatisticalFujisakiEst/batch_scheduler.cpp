@@ -0,0 +1,64 @@
+#include <algorithm>
+#include "batch_scheduler.hpp"
+
+
+namespace stfmest
+{
+    BatchScheduler::BatchScheduler(unsigned workerNum, unsigned long long memBudget,
+                                   const std::vector<unsigned long long> &predictedBytes):
+        workerNum(std::max(workerNum, 1u)), memBudget(memBudget), predictedBytes(predictedBytes)
+    {
+        isStarted.assign(predictedBytes.size(), 0);
+        deferredNum.assign(predictedBytes.size(), 0);
+    }
+
+
+    int BatchScheduler::_pick(unsigned long long retainedBytes)
+    {
+        while (firstPending < isStarted.size() && isStarted[firstPending]) ++firstPending;
+
+        for (unsigned job=firstPending; job<isStarted.size(); job++)
+        {
+            if (isStarted[job]) continue;
+            unsigned long long needed = committedBytes - retainedBytes + std::max(retainedBytes, predictedBytes[job]);
+            if (memBudget == 0 || runningNum == 0 || needed <= memBudget)
+            {
+                if (job != firstPending) ++deferredNum[firstPending];
+                return job;
+            }
+            // Wait for the others to drain rather than starving the first job.
+            if (deferredNum[firstPending] >= 2 * workerNum) return -1;
+        }
+        return -1;
+    }
+
+
+    int BatchScheduler::acquire(unsigned long long retainedBytes)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        int job = -1;
+        cv.wait(lock, [&]()
+        {
+            job = _pick(retainedBytes);
+            return job >= 0 || firstPending >= isStarted.size();
+        });
+        if (job < 0) return -1;
+
+        isStarted[job] = 1;
+        ++runningNum;
+        committedBytes += std::max(retainedBytes, predictedBytes[job]) - retainedBytes;
+        return job;
+    }
+
+
+    void BatchScheduler::release(int job, unsigned long long retainedBytesBefore, unsigned long long retainedBytes)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            --runningNum;
+            committedBytes -= std::max(retainedBytesBefore, predictedBytes[job]);
+            committedBytes += retainedBytes;
+        }
+        cv.notify_all();
+    }
+}
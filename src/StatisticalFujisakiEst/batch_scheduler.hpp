@@ -0,0 +1,48 @@
+// Admission of inputs to parallel workers within a memory budget
+//
+// A job is started only if the sum of the memory of all workers stays
+// within the budget: the predicted bytes of a running job, or the bytes
+// retained by an idle worker's estimator. Jobs are started in order,
+// but smaller jobs may overtake one which does not fit for a while.
+
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+
+namespace stfmest
+{
+    class BatchScheduler
+    {
+    public:
+        // memBudget == 0: unlimited
+        BatchScheduler(unsigned workerNum, unsigned long long memBudget,
+                       const std::vector<unsigned long long> &predictedBytes);
+
+        // Blocks until a job can be started on the worker which retains retainedBytes.
+        // Returns the job No., or -1 if no job is left.
+        int acquire(unsigned long long retainedBytes);
+
+        // The job finished and the worker retains retainedBytes now.
+        void release(int job, unsigned long long retainedBytesBefore, unsigned long long retainedBytes);
+
+        // false: the job is started only when no other job is running
+        inline bool fitsAlone(int job) const { return memBudget == 0 || predictedBytes[job] <= memBudget; }
+
+    private:
+        unsigned workerNum;
+        unsigned long long memBudget;
+        std::vector<unsigned long long> predictedBytes;
+
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::vector<char> isStarted;
+        std::vector<unsigned> deferredNum; // times overtaken by other jobs
+        unsigned firstPending = 0;
+        unsigned runningNum = 0;
+        unsigned long long committedBytes = 0; // sum over the workers
+
+        int _pick(unsigned long long retainedBytes);
+    };
+}
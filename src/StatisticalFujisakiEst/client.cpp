@@ -0,0 +1,101 @@
+// Client of the estimation server (see server.hpp) for testing
+//
+// Sends the input signals one by one and writes the results.
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "cmdline.h"
+
+#include "iofile.hpp"
+#include "timer.hpp"
+#include "server.hpp"
+
+
+int main(int argc, char *argv[])
+{
+    cmdline::parser args;
+    args.add<std::string>("socket", 's', "socket of the server", false, "stfmest.sock");
+    args.add<std::string>("in", 'i', "input data file name", false, "input.json");
+    args.add<std::string>("out", 'o', "output file name", false, "output.json");
+    args.add<std::string>("const", 'x', "external constraint file name(optional)", false, "");
+    args.add("shutdown", '\0', "stop the server after the inputs");
+    args.parse_check(argc, argv);
+
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::string socketPath = args.get<std::string>("socket");
+    std::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        std::cerr << "Cannot connect to " << socketPath << ": " << std::strerror(errno) << std::endl;
+        exit(1);
+    }
+
+    std::vector<nlohmann::json> inputs;
+    if (args.exist("in") || !args.exist("shutdown"))
+    {
+        nlohmann::json inputdatajson = jsonread(args.get<std::string>("in"));
+        if (inputdatajson.is_array())
+        {
+            for (auto id_ : inputdatajson) inputs.push_back(id_);
+        }
+        else
+        {
+            inputs.push_back(inputdatajson);
+        }
+    }
+
+    nlohmann::json constraintjson;
+    if (args.get<std::string>("const") != "")
+    {
+        constraintjson = jsonread(args.get<std::string>("const")).at("constraintData");
+        if (constraintjson.size() < inputs.size())
+        {
+            std::cerr << "Less than No. of input signal. Abort." << std::endl;
+            exit(1);
+        }
+    }
+
+    nlohmann::json resultarray = nlohmann::json::array();
+    for (unsigned i=0; i<inputs.size(); i++)
+    {
+        nlohmann::json request = inputs[i];
+        if (!constraintjson.is_null()) request = nlohmann::json{{"input", inputs[i]}, {"constraints", constraintjson[i]}};
+
+        stfmest::Timer t;
+        t.start();
+        nlohmann::json response;
+        if (!stfmest::writeMessage(fd, request) || !stfmest::readMessage(fd, response))
+        {
+            std::cerr << "Connection closed by the server." << std::endl;
+            exit(1);
+        }
+        t.stop();
+        if (stfmest::isErrorResult(response))
+        {
+            std::cout << "[Input " << i << "] Error: " << response["error"] << std::endl;
+        }
+        else
+        {
+            std::cout << "[Input " << i << "] RMSE: " << response["rmse"] << " in " << t.get() << " sec." << std::endl;
+        }
+        resultarray.push_back(response);
+    }
+    if (!inputs.empty()) jsonwrite(args.get<std::string>("out"), resultarray);
+
+    if (args.exist("shutdown"))
+    {
+        nlohmann::json response;
+        stfmest::writeMessage(fd, nlohmann::json{{"shutdown", true}});
+        stfmest::readMessage(fd, response);
+    }
+    close(fd);
+    return 0;
+}
@@ -1,18 +1,148 @@
+#include <cmath>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <thread>
 #include "cmdline.h"
 
 #include "iofile.hpp"
 #include "timer.hpp"
-#include "em_estimation.hpp"
-#include "evaluation.hpp"
-#include "external_constraint.hpp"
+#include "trace.hpp"
+#include "error_codes.hpp"
+#include "estimator.hpp"
+#include "streaming_estimation.hpp"
+#include "segmentation.hpp"
+#include "batch_scheduler.hpp"
+#ifdef STFMEST_ENABLE_SERVER
+#include "server.hpp"
+#endif
 
 
 stfmest::EstimationConfig config;
 stfmest::TransParams hmmprob;
 std::vector<stfmest::InputData> inputdata;
 std::vector<stfmest::EstimationResult> results;
+std::vector<std::vector<stfmest::StochasticCommandConstraint> > constraints; // empty if not specified
+std::vector<stfmest::EstimationResult> initialEstimates; // empty if not specified
+std::vector<bool> hasInitialEstimate; // false for the failed items of the previous output
+std::mutex coutMutex;
+
+
+// An input, or a chunk of it when segmented (see segmentation.hpp)
+struct EstimationJob
+{
+    unsigned input;
+    int chunk; // -1 for the whole input
+    stfmest::InputData slice; // used iff chunk >= 0
+    stfmest::EstimationResult result;
+    int status; // error code (see error_codes.hpp); result is not used unless NO_ERROR
+    const stfmest::InputData &data() const { return chunk < 0 ? inputdata[input] : slice; }
+};
+std::vector<EstimationJob> jobs;
+
+
+// Constraints of the i-th input, or nullptr
+static const std::vector<stfmest::StochasticCommandConstraint> *constraintsOf(unsigned i)
+{
+    return constraints.empty() ? nullptr : &constraints[i];
+}
+
+
+// Previous estimation result of the i-th input, or nullptr to estimate it cold
+static const stfmest::EstimationResult *initialEstimateOf(unsigned i)
+{
+    return initialEstimates.empty() || !hasInitialEstimate[i] ? nullptr : &initialEstimates[i];
+}
+
+
+static std::string labelOf(const EstimationJob &job)
+{
+    std::string label = "Input " + std::to_string(job.input);
+    if (job.chunk >= 0) label += " chunk " + std::to_string(job.chunk);
+    return label;
+}
+
+
+// Estimates a job and stores the result in job.result, or the error in job.status.
+static void estimateOne(stfmest::Estimator &estimator, EstimationJob &job)
+{
+    STFMEST_TRACE_SCOPE(labelOf(job));
+    unsigned i = job.input;
+    stfmest::Timer t;
+    t.start();
+    job.status = estimator.estimate(job.data(), constraintsOf(i), job.result, initialEstimateOf(i));
+    t.stop();
+    std::lock_guard<std::mutex> lock(coutMutex);
+    if (job.status)
+    {
+        std::cout << "[" << labelOf(job) << "] failed with status " << job.status << "." << std::endl;
+        return;
+    }
+    std::cout << "[" << labelOf(job) << "] RMSE: " << job.result.rmse << " in " << t.get() << " sec. [End]" << std::endl;
+}
+
+
+// Feeds a job frame by frame to a streaming estimator and stores the emitted commands in job.result,
+// or the error in job.status.
+static void streamOne(const stfmest::StreamingConfig &sc, EstimationJob &job)
+{
+    STFMEST_TRACE_SCOPE(labelOf(job));
+    const stfmest::InputData &id_ = job.data();
+    unsigned frameNum = id_.logf0.size();
+    stfmest::StreamingEstimation stream(config, hmmprob, sc, id_.fs, id_.initial_mub);
+    stfmest::EstimationResult &er = job.result;
+    double maxLatency = 0.0; // from the onset to the emission [sec]
+
+    stfmest::Timer t;
+    t.start();
+    int status = stfmest::isInputLengthConsistent(id_) ? stfmest::NO_ERROR : stfmest::INPUT_VECTOR_SIZE_MISMATCH;
+    for (unsigned begin=0; begin<frameNum && !status; begin++)
+    {
+        unsigned end = begin + 1;
+        unsigned emittedBefore = er.commands.size();
+        status = stream.push(stfmest::sliceInput(id_, stfmest::InputChunk{begin, end, begin, end}), er.commands);
+        for (unsigned k=emittedBefore; k<er.commands.size(); k++)
+        {
+            maxLatency = std::max(maxLatency, end / id_.fs - er.commands[k].onset);
+        }
+    }
+    if (!status) status = stream.finish(er.commands);
+    t.stop();
+
+    er.mub = stream.getMub();
+    er.fs = id_.fs;
+    if (!status) er.regeneratedlf0 = stfmest::criticalfilter(er.commands, er.mub, id_.fs, frameNum, &status);
+    if (!status) er.rmse = stfmest::rmse(id_.logf0, er.regeneratedlf0, id_.vuv, config.zeroThreshold, &status);
+    er.voicedFrameNum = 0;
+    for (auto vuv : id_.vuv) if (vuv > config.zeroThreshold) ++(er.voicedFrameNum);
+    job.status = status;
+    std::lock_guard<std::mutex> lock(coutMutex);
+    if (status)
+    {
+        std::cout << "[" << labelOf(job) << "] failed with status " << status << "." << std::endl;
+        return;
+    }
+    std::cout << "[" << labelOf(job) << "] RMSE: " << er.rmse << " in " << t.get()
+              << " sec., max. latency " << maxLatency << " sec. [End]" << std::endl;
+}
+
+
+// "8G", "512M", "100000K" or bytes
+static unsigned long long parseBytes(const std::string &str)
+{
+    std::size_t pos = 0;
+    double value = std::stod(str, &pos);
+    std::string unit = str.substr(pos);
+    if (unit == "K" || unit == "k") value *= 1024.0;
+    else if (unit == "M" || unit == "m") value *= 1024.0 * 1024.0;
+    else if (unit == "G" || unit == "g") value *= 1024.0 * 1024.0 * 1024.0;
+    else if (unit != "")
+    {
+        std::cerr << "Invalid memory size: " << str << std::endl;
+        exit(1);
+    }
+    return (unsigned long long)value;
+}
 
 
 int main(int argc, char *argv[])
@@ -26,8 +156,32 @@ int main(int argc, char *argv[])
     args.add<std::string>("truth", 't', "truth command data file name(optional)", false, "");
     args.add<std::string>("eval", 'e', "evaluation result file name", false, "evaluation.json");
     args.add<std::string>("const", 'x', "external constraint file name(optional)", false, "");
+    args.add<std::string>("init", 'w', "previous output file name to start from(optional)", false, "");
+    args.add("profile", '\0', "output the running time of each phase and operation counts");
+    args.add<std::string>("trace", '\0', "Chrome trace event file name(optional)", false, "");
+    args.add<unsigned>("jobs", 'j', "No. of inputs estimated in parallel", false, 1);
+    args.add<std::string>("mem-budget", '\0', "memory for all the jobs, e.g. 8G (0: unlimited)", false, "0");
+    args.add<double>("segment", '\0', "split inputs longer than this [sec] at pauses into chunks (0: off)", false, 0.0);
+    args.add<double>("pause", '\0', "min. unvoiced duration [sec] where inputs are split", false, 0.3);
+    args.add<double>("overlap", '\0', "overlap [sec] of the chunks on each side of a split", false, 0.5);
+    args.add<double>("stream", '\0', "estimate inputs as streams with this window [sec] (0: off)", false, 0.0);
+    args.add<double>("lag", '\0', "delay [sec] before commands are emitted in the stream mode", false, 1.0);
+    args.add<double>("hop", '\0', "interval [sec] of the window estimation in the stream mode", false, 0.5);
+    args.add<int>("window-iterations", '\0', "iterationNum of a window after the first in the stream mode (negative: warmStartIterationNum)", false, 5);
+#ifdef STFMEST_ENABLE_SERVER
+    args.add<std::string>("serve", '\0', "serve requests on this Unix domain socket instead of the input file", false, "");
+#endif
     args.parse_check(argc, argv);
 
+    if (args.get<std::string>("trace") != "")
+    {
+#ifndef STFMEST_ENABLE_TRACE
+        std::cerr << "Tracing is not compiled in; configure with -DSTFMEST_ENABLE_TRACE=ON." << std::endl;
+#endif
+        stfmest::TraceCollector::instance().enable(true);
+        STFMEST_TRACE_THREAD_NAME("main");
+    }
+
 
     // Load config file
     config = jsonread(args.get<std::string>("config"));
@@ -37,6 +191,14 @@ int main(int argc, char *argv[])
     hmmprob = jsonread(args.get<std::string>("prob"));
     std::cout << "Loaded HMM probability data." << std::endl;
 
+#ifdef STFMEST_ENABLE_SERVER
+    if (args.get<std::string>("serve") != "")
+    {
+        stfmest::EstimationServer server(config, hmmprob, args.get<unsigned>("jobs"));
+        return server.run(args.get<std::string>("serve")) == 0 ? 0 : 1;
+    }
+#endif
+
     // Load input data.
     nlohmann::json inputdatajson = jsonread(args.get<std::string>("in"));
     if (inputdatajson.is_array())
@@ -51,11 +213,19 @@ int main(int argc, char *argv[])
     }
 
     // Load ground truth command file if specified
+    // An entry is an array of commands, or an estimation result (e.g. of another build).
     std::vector<std::vector<stfmest::FujisakiCommand> > groundtruth;
+    std::vector<bool> hasGroundtruth; // false for the failed items of an output
     if (args.get<std::string>("truth") != "")
     {
         nlohmann::json tmpj = jsonread(args.get<std::string>("truth"));
-        for (auto i : tmpj) groundtruth.push_back(i);
+        for (const auto &i : tmpj)
+        {
+            bool isError = stfmest::isErrorResult(i);
+            if (isError) groundtruth.push_back({});
+            else groundtruth.push_back(i.is_object() ? i.at("commands") : i);
+            hasGroundtruth.push_back(!isError);
+        }
         std::cout << "Loaded " << groundtruth.size() << " truth command patterns." << std::endl;
         if (groundtruth.size() < inputdata.size())
         {
@@ -65,95 +235,214 @@ int main(int argc, char *argv[])
     }
 
     // Load external constraint file if specified
-    nlohmann::json constraintjson;
-
     if (args.get<std::string>("const") != "")
     {
         nlohmann::json constraintJson_tmp = jsonread(args.get<std::string>("const"));
-        constraintjson = constraintJson_tmp.at("constraintData");
-        std::cout << "Loaded " << constraintjson.size() << " constraint data" << std::endl;
-        if (constraintjson.size() < inputdata.size())
+        for (auto constraintsOfInput : constraintJson_tmp.at("constraintData"))
+        {
+            constraints.push_back(std::vector<stfmest::StochasticCommandConstraint>());
+            for (auto singleC : constraintsOfInput) constraints.back().push_back(singleC);
+        }
+        std::cout << "Loaded " << constraints.size() << " constraint data" << std::endl;
+        if (constraints.size() < inputdata.size())
         {
 			std::cerr << "Less than No. of input signal. Abort." << std::endl;
 			exit(1);
         }
     }
 
-    nlohmann::json resultarray;
+    // Load previous estimation results if specified
+    if (args.get<std::string>("init") != "")
+    {
+        nlohmann::json initjson = jsonread(args.get<std::string>("init"));
+        if (!initjson.is_array()) initjson = nlohmann::json::array({initjson});
+        for (const auto &er_ : initjson)
+        {
+            bool isError = stfmest::isErrorResult(er_);
+            initialEstimates.push_back(isError ? stfmest::EstimationResult() : er_.get<stfmest::EstimationResult>());
+            hasInitialEstimate.push_back(!isError);
+        }
+        std::cout << "Loaded " << initialEstimates.size() << " previous estimation results." << std::endl;
+        if (initialEstimates.size() < inputdata.size())
+        {
+            std::cerr << "Less than No. of input signal. Abort." << std::endl;
+            exit(1);
+        }
+    }
+
+    // Split long inputs into chunks estimated as separate jobs.
+    stfmest::SegmentationConfig segconfig;
+    segconfig.maxChunkSec = args.get<double>("segment");
+    segconfig.minPauseSec = args.get<double>("pause");
+    segconfig.overlapSec = args.get<double>("overlap");
+    bool isSegmented = segconfig.maxChunkSec > 0.0;
+    if (isSegmented && (!constraints.empty() || !initialEstimates.empty()))
+    {
+        std::cerr << "Segmentation cannot be used with external constraints or previous results. Abort." << std::endl;
+        exit(1);
+    }
 
+    stfmest::StreamingConfig streamconfig;
+    streamconfig.windowSec = args.get<double>("stream");
+    streamconfig.lagSec = args.get<double>("lag");
+    streamconfig.hopSec = args.get<double>("hop");
+    streamconfig.windowIterationNum = args.get<int>("window-iterations");
+    bool isStreamed = streamconfig.windowSec > 0.0;
+    if (isStreamed && (isSegmented || !constraints.empty() || !initialEstimates.empty()))
+    {
+        std::cerr << "The stream mode cannot be used with segmentation, external constraints or previous results. Abort." << std::endl;
+        exit(1);
+    }
+
+    std::vector<std::vector<stfmest::InputChunk> > chunks(inputdata.size());
     for (unsigned i=0; i<inputdata.size(); i++)
     {
-        stfmest::InputData id_ = inputdata[i];
-        if (args.get<std::string>("const") != "")
+        // An inconsistent input is estimated as a whole to fail alone.
+        if (isSegmented && stfmest::isInputLengthConsistent(inputdata[i]))
+        {
+            chunks[i] = stfmest::splitAtPauses(inputdata[i], segconfig, config.zeroThreshold);
+        }
+        if (chunks[i].size() <= 1)
+        {
+            jobs.push_back(EstimationJob{i, -1, stfmest::InputData(), stfmest::EstimationResult(), stfmest::NO_ERROR});
+            continue;
+        }
+        std::cout << "[Input " << i << "] split into " << chunks[i].size() << " chunks." << std::endl;
+        for (unsigned k=0; k<chunks[i].size(); k++)
+        {
+            jobs.push_back(EstimationJob{i, (int)k, stfmest::sliceInput(inputdata[i], chunks[i][k]),
+                                         stfmest::EstimationResult(), stfmest::NO_ERROR});
+        }
+    }
+
+    // Each worker reuses its estimator for its jobs to keep the memory allocated.
+    unsigned jobNum = std::max(args.get<unsigned>("jobs"), 1u);
+    bool isProfileEnabled = args.exist("profile");
+    unsigned long long memBudget = parseBytes(args.get<std::string>("mem-budget"));
+    results.resize(inputdata.size());
+
+    std::vector<unsigned long long> predictedBytes(jobs.size(), 0);
+    if (memBudget > 0)
+    {
+        stfmest::Estimator planner(config, hmmprob);
+        for (unsigned j=0; j<jobs.size(); j++)
         {
-            config.isHmmSerialized = true;
-            nlohmann::json acc_const = constraintjson[i];
-            int accentnum = acc_const.size();
-            config.accentBigStateNum = accentnum;
+            unsigned frameNum = jobs[j].data().logf0.size();
+            if (isStreamed) frameNum = std::min(frameNum, (unsigned)std::round(streamconfig.windowSec * jobs[j].data().fs));
+            predictedBytes[j] = planner.predictMemoryBytes(frameNum, constraintsOf(jobs[j].input));
         }
-        stfmest::EmEstimationConstrained em(config);
-        em.loadInputData(id_);
+    }
+    stfmest::BatchScheduler scheduler(jobNum, memBudget, predictedBytes);
+    for (unsigned j=0; j<jobs.size(); j++)
+    {
+        if (scheduler.fitsAlone(j)) continue;
+        std::cout << "[" << labelOf(jobs[j]) << "] needs " << predictedBytes[j]
+                  << " bytes over the budget; estimated alone." << std::endl;
+    }
 
-        std::vector<stfmest::StochasticCommandConstraint> constraintInfo;
-        if (args.get<std::string>("const") != "")
-            for (auto singleC : constraintjson[i])
+    auto work = [&](unsigned worker)
+    {
+        STFMEST_TRACE_THREAD_NAME(jobNum > 1 ? "worker " + std::to_string(worker) : "main");
+        stfmest::Estimator estimator(config, hmmprob);
+        estimator.enableProfile(isProfileEnabled);
+        unsigned long long retainedBytes = 0;
+        for (int i = scheduler.acquire(retainedBytes); i >= 0; i = scheduler.acquire(retainedBytes))
+        {
+            if (isStreamed)
             {
-                constraintInfo.push_back(singleC);
-                // std::cout << singleC << std::endl;
+                streamOne(streamconfig, jobs[i]);
+                scheduler.release(i, retainedBytes, retainedBytes);
+                continue;
             }
-        int status;
-        if (config.enableLimitedDurationExtension)
-        {
-            em.loadTransparams(hmmprob, false);
-            // std::cout << "Transparams loaded" << std::endl;
-            em.emPreparation();
-            // std::cout << "Preparation finished." << std::endl;
-            if (args.get<std::string>("const") != "") em.imposeStochasticConst(constraintInfo);
-            // std::cout << "Constraint introduced" << std::endl;
-            status = em.validate();
-            if (status)
+            estimateOne(estimator, jobs[i]);
+            unsigned long long retainedBytesBefore = retainedBytes;
+            retainedBytes = estimator.getRetainedBytes();
+            if (memBudget > 0 && retainedBytes > memBudget / jobNum)
             {
-                std::cout << "[HMMprob modified]";
-                em.loadTransparams(hmmprob, true);
-                em.emPreparation();
-                if (args.get<std::string>("const") != "") em.imposeStochasticConst(constraintInfo);
-                status = em.validate();
+                // Release the memory for a long input to the other workers.
+                estimator.releaseMemory();
+                retainedBytes = 0;
             }
+            scheduler.release(i, retainedBytesBefore, retainedBytes);
         }
-        else
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned w=1; w<jobNum; w++) workers.push_back(std::thread(work, w));
+    work(0);
+    for (auto &t : workers) t.join();
+
+    // Collect the results, stitching the chunks.
+    // An input fails with the first failed chunk, and the others are estimated anyway.
+    std::vector<std::vector<stfmest::ChunkBoundaryReport> > segmentReports(inputdata.size());
+    std::vector<std::vector<stfmest::EstimationResult> > chunkResults(inputdata.size());
+    std::vector<int> statuses(inputdata.size(), stfmest::NO_ERROR);
+    for (auto &job : jobs)
+    {
+        if (job.status && !statuses[job.input]) statuses[job.input] = job.status;
+        if (job.chunk < 0) results[job.input] = std::move(job.result);
+        else chunkResults[job.input].push_back(std::move(job.result));
+    }
+    unsigned failedNum = 0;
+    for (unsigned i=0; i<inputdata.size(); i++)
+    {
+        if (!chunkResults[i].empty() && !statuses[i])
         {
-            em.loadTransparams(hmmprob, true);
-            em.emPreparation();
-            if (args.get<std::string>("const") != "") em.imposeStochasticConst(constraintInfo);
-        status = em.validate();
+            results[i] = stfmest::stitchResults(inputdata[i], chunks[i], chunkResults[i], segconfig,
+                                                config.zeroThreshold, segmentReports[i], &statuses[i]);
+            if (statuses[i]) std::cerr << "[Input " << i << "] stitching failed: " << statuses[i] << std::endl;
         }
+        if (statuses[i]) ++failedNum;
+        if (chunkResults[i].empty() || statuses[i]) continue;
+        std::cout << "[Input " << i << "] stitched RMSE: " << results[i].rmse << std::endl;
+        for (const auto &report : segmentReports[i])
+        {
+            if (report.isConsistent) continue;
+            std::cout << "[Input " << i << "] chunks disagree around frame " << report.cutFrame << ":";
+            for (const auto &c : report.coincidence)
+            {
+                std::cout << (c.first == stfmest::CMD_PHRASE ? " phrase " : " accent ")
+                          << c.second.totalNumInReference << " vs " << c.second.totalNumInEstimated
+                          << " (" << c.second.matchedNum << " matched),";
+            }
+            std::cout << " " << report.droppedNum << " dropped" << std::endl;
+        }
+    }
 
-        if (status)
+    // A failed input is kept in its place as {"error", "status"}.
+    nlohmann::json resultarray;
+    for (unsigned i=0; i<results.size(); i++)
+    {
+        if (statuses[i])
         {
-            std::cout << "EM prepared: " << status << std::endl;
-            exit(1);
+            resultarray.push_back({{"error", "estimation failed"}, {"status", statuses[i]}});
+            continue;
         }
-        std::cout << "EM starts." << std::endl;
-        stfmest::Timer t;
-        t.start();
-        em.launch();
-        t.stop();
-        // std::cout << "EM finished." << std::endl;
-        results.push_back(em.getResult());
-        std::cout << "[Input " << i << "] RMSE: " << results.back().rmse << " in " << t.get() << " sec. [End]" << std::endl;
-        resultarray.push_back(results.back());
+        resultarray.push_back(results[i]);
+        if (!segmentReports[i].empty()) resultarray.back()["segmentation"] = segmentReports[i];
     }
 
     jsonwrite(args.get<std::string>("out"), resultarray);
 
+    if (args.get<std::string>("trace") != "")
+    {
+        if (!stfmest::TraceCollector::instance().write(args.get<std::string>("trace")))
+        {
+            std::cerr << "Cannot write the trace to " << args.get<std::string>("trace") << "." << std::endl;
+        }
+    }
+
 
     // evaluation
     if (args.get<std::string>("truth") != "")
     {
+        stfmest::Estimator evaluator(config, hmmprob);
         std::vector<std::vector<std::pair<stfmest::FilterType, stfmest::CommandsCoincidenceResult> > > evalresults;
         for (unsigned i=0; i<inputdata.size(); i++)
         {
-            evalresults.push_back(evaluateByDP(groundtruth[i], results[i].commands, 0.1, config.zeroThreshold));
+            // Failed inputs are not counted in the total.
+            if (statuses[i] || !hasGroundtruth[i]) evalresults.push_back({});
+            else evalresults.push_back(evaluator.evaluate(groundtruth[i], results[i]));
         }
 
         std::vector<std::pair<stfmest::FilterType, stfmest::CommandsCoincidenceResult> > evalTotal{{stfmest::CMD_PHRASE, stfmest::CommandsCoincidenceResult()}, {stfmest::CMD_ACCENT, stfmest::CommandsCoincidenceResult()}};
@@ -183,5 +472,10 @@ int main(int argc, char *argv[])
         jsonwrite(args.get<std::string>("eval"), evalresults);
     }
 
+    if (failedNum > 0)
+    {
+        std::cout << failedNum << " of " << inputdata.size() << " inputs failed." << std::endl;
+        return 1;
+    }
     return 0;
 }
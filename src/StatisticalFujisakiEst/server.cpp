@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "server.hpp"
+#include "timer.hpp"
+#include "error_codes.hpp"
+
+
+namespace stfmest
+{
+    static const unsigned MAX_MESSAGE_BYTES = 1u << 30;
+
+
+    static bool _readAll(int fd, char *buf, std::size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t n = read(fd, buf, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            buf += n;
+            size -= n;
+        }
+        return true;
+    }
+
+
+    static bool _writeAll(int fd, const char *buf, std::size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t n = write(fd, buf, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            buf += n;
+            size -= n;
+        }
+        return true;
+    }
+
+
+    bool readMessage(int fd, nlohmann::json &message)
+    {
+        unsigned char header[4];
+        if (!_readAll(fd, (char *)header, 4)) return false;
+        unsigned size = (unsigned)header[0] << 24 | (unsigned)header[1] << 16 | (unsigned)header[2] << 8 | header[3];
+        if (size > MAX_MESSAGE_BYTES) return false;
+        std::string text(size, '\0');
+        if (!_readAll(fd, &text[0], size)) return false;
+        try
+        {
+            message = nlohmann::json::parse(text);
+        }
+        catch (std::exception &e)
+        {
+            message = nlohmann::json{{"error", std::string("invalid JSON: ") + e.what()}, {"status", VALUE_INVALID}};
+        }
+        return true;
+    }
+
+
+    bool writeMessage(int fd, const nlohmann::json &message)
+    {
+        std::string text = message.dump();
+        if (text.size() > MAX_MESSAGE_BYTES) return false;
+        unsigned size = text.size();
+        unsigned char header[4] = {(unsigned char)(size >> 24), (unsigned char)(size >> 16),
+                                   (unsigned char)(size >> 8), (unsigned char)size};
+        return _writeAll(fd, (const char *)header, 4) && _writeAll(fd, text.data(), text.size());
+    }
+
+
+    EstimationServer::EstimationServer(const EstimationConfig &ec, const TransParams &tp, unsigned workerNum):
+        estimator(ec, tp), workerNum(std::max(workerNum, 1u))
+    {
+    }
+
+
+    int EstimationServer::run(const std::string &socketPath)
+    {
+        sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(addr.sun_path))
+        {
+            std::cerr << "Socket path too long: " << socketPath << std::endl;
+            return -1;
+        }
+        std::strcpy(addr.sun_path, socketPath.c_str());
+
+        // Remove the socket left by a previous server, but no other file.
+        struct stat st;
+        if (stat(socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) unlink(socketPath.c_str());
+
+        int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0
+            || bind(listenFd, (sockaddr *)&addr, sizeof(addr)) < 0
+            || listen(listenFd, 16) < 0)
+        {
+            std::cerr << "Cannot listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+            if (listenFd >= 0) close(listenFd);
+            return -1;
+        }
+        signal(SIGPIPE, SIG_IGN); // a closed client fails the write instead
+        std::cout << "Listening on " << socketPath << " with " << workerNum << " workers." << std::endl;
+
+        std::vector<std::thread> workers;
+        for (unsigned w=0; w<workerNum; w++) workers.push_back(std::thread(&EstimationServer::_work, this));
+
+        std::vector<std::thread> connectionThreads; // live ones, and finished ones not joined yet
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (isStopping) break;
+                _joinFinishedConnections(connectionThreads);
+            }
+            // Wake up now and then to see isStopping.
+            pollfd pfd = {listenFd, POLLIN, 0};
+            if (poll(&pfd, 1, 200) <= 0) continue;
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) continue;
+            std::lock_guard<std::mutex> lock(mtx);
+            connections.push_back(fd);
+            connectionThreads.push_back(std::thread(&EstimationServer::_serveConnection, this, fd));
+        }
+        close(listenFd);
+        unlink(socketPath.c_str());
+
+        for (auto &t : connectionThreads) t.join();
+        cv.notify_all();
+        for (auto &t : workers) t.join();
+        std::cout << "Served " << requestNum << " requests." << std::endl;
+        return 0;
+    }
+
+
+    void EstimationServer::_joinFinishedConnections(std::vector<std::thread> &connectionThreads)
+    {
+        // A finished thread has only to return after releasing mtx.
+        for (std::thread::id id : finishedConnections)
+        {
+            auto it = std::find_if(connectionThreads.begin(), connectionThreads.end(),
+                                   [id](const std::thread &t){ return t.get_id() == id; });
+            if (it == connectionThreads.end()) continue;
+            it->join();
+            connectionThreads.erase(it);
+        }
+        finishedConnections.clear();
+    }
+
+
+    void EstimationServer::stop()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        isStopping = true;
+        // Let the connections waiting for a request finish.
+        for (int fd : connections) shutdown(fd, SHUT_RD);
+    }
+
+
+    void EstimationServer::_serveConnection(int fd)
+    {
+        nlohmann::json request;
+        while (readMessage(fd, request))
+        {
+            if (request.is_object() && request.count("shutdown"))
+            {
+                writeMessage(fd, nlohmann::json{{"shutdown", true}});
+                stop();
+                break;
+            }
+
+            nlohmann::json response;
+            if (isErrorResult(request))
+            {
+                response = request; // not parsed
+            }
+            else
+            {
+                Task task;
+                task.request = std::move(request);
+                std::future<nlohmann::json> future = task.response.get_future();
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    tasks.push_back(&task);
+                }
+                cv.notify_one();
+                response = future.get();
+            }
+            if (!writeMessage(fd, response)) break;
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        connections.erase(std::find(connections.begin(), connections.end(), fd));
+        close(fd);
+        finishedConnections.push_back(std::this_thread::get_id());
+    }
+
+
+    void EstimationServer::_work()
+    {
+        while (true)
+        {
+            Task *task;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [this]{ return !tasks.empty() || (isStopping && connections.empty()); });
+                if (tasks.empty()) return;
+                task = tasks.front();
+                tasks.pop_front();
+            }
+            task->response.set_value(_estimate(task->request));
+        }
+    }
+
+
+    nlohmann::json EstimationServer::_estimate(const nlohmann::json &request)
+    {
+        InputData id_;
+        std::vector<StochasticCommandConstraint> constraintInfo;
+        bool hasConst = false;
+        try
+        {
+            if (request.count("input"))
+            {
+                id_ = request.at("input");
+                hasConst = request.count("constraints") > 0;
+                if (hasConst) for (auto singleC : request.at("constraints")) constraintInfo.push_back(singleC);
+            }
+            else
+            {
+                id_ = request;
+            }
+        }
+        catch (std::exception &e)
+        {
+            return nlohmann::json{{"error", std::string("invalid request: ") + e.what()}, {"status", VALUE_INVALID}};
+        }
+
+        Timer t;
+        t.start();
+        EstimationResult er;
+        int status = estimator.estimate(id_, hasConst ? &constraintInfo : nullptr, er);
+        t.stop();
+        if (status)
+        {
+            return nlohmann::json{{"error", "input cannot be estimated"}, {"status", status}};
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        std::cout << "[Request " << requestNum++ << "] RMSE: " << er.rmse << " in " << t.get() << " sec." << std::endl;
+        return er;
+    }
+}
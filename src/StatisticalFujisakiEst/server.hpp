@@ -0,0 +1,63 @@
+// Estimation server on a Unix domain socket
+//
+// The config and the HMM probabilities are loaded once. Requests of all
+// connections are estimated by a pool of workers sharing an Estimator,
+// which keeps the estimators (and so the HMMs made for them) between requests.
+//
+// A message in either direction is a 4-byte length (big endian) followed by JSON text.
+// Request:  InputData, or {"input": InputData, "constraints": [StochasticCommandConstraint, ...]},
+//           or {"shutdown": true} to stop the server.
+// Response: EstimationResult, or {"error": message, "status": FujisakiemError}.
+
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "json.hpp"
+#include "estimator.hpp"
+
+
+namespace stfmest
+{
+    // false at the end of the stream or on an error
+    bool readMessage(int fd, nlohmann::json &message);
+    bool writeMessage(int fd, const nlohmann::json &message);
+
+
+    class EstimationServer
+    {
+    public:
+        EstimationServer(const EstimationConfig &ec, const TransParams &tp, unsigned workerNum);
+
+        // Serves until a shutdown request. Returns 0, or -1 if the socket cannot be opened.
+        int run(const std::string &socketPath);
+        void stop();
+
+    private:
+        struct Task
+        {
+            nlohmann::json request;
+            std::promise<nlohmann::json> response;
+        };
+
+        Estimator estimator;
+        unsigned workerNum;
+
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<Task *> tasks;
+        bool isStopping = false;
+        std::vector<int> connections; // open client sockets
+        std::vector<std::thread::id> finishedConnections; // threads to be joined by run()
+        unsigned long long requestNum = 0;
+
+        void _work();
+        void _serveConnection(int fd);
+        void _joinFinishedConnections(std::vector<std::thread> &connectionThreads); // with mtx locked
+        nlohmann::json _estimate(const nlohmann::json &request);
+    };
+}
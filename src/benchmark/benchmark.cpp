@@ -0,0 +1,128 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "cmdline.h"
+
+#include "iofile.hpp"
+#include "timer.hpp"
+#include "em_estimation.hpp"
+#include "synthetic_input.hpp"
+
+
+// Sum of the running times of the calls in the EM iterations [sec]
+static double sum(const std::vector<double> &times)
+{
+    double total = 0.0;
+    for (double time : times) total += time;
+    return total;
+}
+
+
+static std::vector<double> parseList(const std::string &str)
+{
+    std::vector<double> values;
+    std::stringstream ss(str);
+    std::string item;
+    while (std::getline(ss, item, ',')) values.push_back(std::stod(item));
+    return values;
+}
+
+
+int main(int argc, char *argv[])
+{
+    cmdline::parser args;
+
+    args.add<std::string>("config", 'c', "config file name", false, "config.json");
+    args.add<std::string>("prob", 'p', "HMM probability file name", false, "hmmprob.json");
+    args.add<std::string>("out", 'o', "output file name (JSON lines, stdout if not given)", false, "");
+    args.add<std::string>("lengths", 'l', "signal lengths [sec], comma-separated", false, "1,3,10");
+    args.add<std::string>("phrase-states", 'P', "phraseBigStateNum's, comma-separated", false, "20");
+    args.add<std::string>("accent-states", 'A', "accentBigStateNum's, comma-separated", false, "20");
+    args.add<double>("fs", 'f', "frame rate [Hz]", false, 125.0);
+    args.add<int>("iterations", 'n', "iterationNum (negative: as in the config file)", false, -1);
+    args.add<unsigned>("repeat", 'r', "No. of runs for each setting", false, 1);
+    args.add<unsigned>("seed", 's', "random seed of the signals", false, 0);
+    args.parse_check(argc, argv);
+
+    stfmest::EstimationConfig config = jsonread(args.get<std::string>("config"));
+    stfmest::TransParams hmmprob = jsonread(args.get<std::string>("prob"));
+    if (args.get<int>("iterations") >= 0) config.iterationNum = args.get<int>("iterations");
+
+    std::ofstream outFile;
+    if (args.get<std::string>("out") != "") outFile.open(args.get<std::string>("out"));
+    std::ostream &out = args.get<std::string>("out") != "" ? outFile : std::cout;
+
+    for (double lengthSec : parseList(args.get<std::string>("lengths")))
+    for (double phraseStateNum : parseList(args.get<std::string>("phrase-states")))
+    for (double accentStateNum : parseList(args.get<std::string>("accent-states")))
+    for (unsigned r=0; r<args.get<unsigned>("repeat"); r++)
+    {
+        stfmest::SyntheticInputConfig sc;
+        sc.fs = args.get<double>("fs");
+        sc.lengthSec = lengthSec;
+        sc.alpha = config.defaultAlpha;
+        sc.beta = config.defaultBeta;
+        sc.seed = args.get<unsigned>("seed") + r;
+        stfmest::InputData id_ = stfmest::makeSyntheticInput(sc);
+
+        config.phraseBigStateNum = (int)phraseStateNum;
+        config.accentBigStateNum = (int)accentStateNum;
+
+        nlohmann::json j{{"lengthSec", lengthSec}, {"fs", sc.fs}, {"frameNum", id_.logf0.size()},
+                         {"isHmmSerialized", config.isHmmSerialized},
+                         {"phraseBigStateNum", config.phraseBigStateNum},
+                         {"accentBigStateNum", config.accentBigStateNum},
+                         {"iterationNum", config.iterationNum}, {"seed", sc.seed}};
+
+        // A new estimator for each run, as the preparation is measured
+        // The EM phases are timed by the estimator's own profile.
+        stfmest::EmEstimation em(config);
+        em.enableProfile(true);
+        stfmest::Timer t;
+        em.reset(id_);
+        em.loadTransparams(hmmprob, !config.enableLimitedDurationExtension);
+        j["estimatedBytes"] = em.estimateMemoryBytes(id_.logf0.size());
+        t.start();
+        em.emPreparation();
+        int status = em.validate();
+        if (status && config.enableLimitedDurationExtension)
+        {
+            em.loadTransparams(hmmprob, true);
+            em.emPreparation();
+            status = em.validate();
+        }
+        double emPreparation = t.lap();
+        j["smallStateNum"] = em.getSmallStates().size();
+        if (status)
+        {
+            j["status"] = status;
+            out << j.dump() << std::endl;
+            continue;
+        }
+
+        status = em.launch();
+        stfmest::EstimationResult er;
+        if (!status) status = em.getResult(er);
+        if (status)
+        {
+            j["status"] = status;
+            out << j.dump() << std::endl;
+            continue;
+        }
+
+        j["status"] = 0;
+        const stfmest::EstimationProfile &profile = er.profile;
+        j["emPreparation"] = emPreparation;
+        j["viterbiAlgorithm"] = sum(profile.viterbiAlgorithm);
+        j["hardMstep"] = sum(profile.hardMstep);
+        j["perturbCommands"] = sum(profile.perturbCommands);
+        j["getResult"] = profile.getResult;
+        j["total"] = emPreparation + sum(profile.viterbiAlgorithm) + sum(profile.hardMstep)
+                     + sum(profile.perturbCommands) + profile.getResult;
+        j["rmse"] = er.rmse;
+        j["peakBytes"] = profile.memory.peakBytes;
+        out << j.dump() << std::endl;
+    }
+    return 0;
+}
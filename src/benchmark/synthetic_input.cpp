@@ -0,0 +1,64 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "synthetic_input.hpp"
+
+
+namespace stfmest
+{
+    InputData makeSyntheticInput(const SyntheticInputConfig &sc, std::vector<FujisakiCommand> *commands)
+    {
+        std::mt19937 rng(sc.seed);
+        auto uniform = [&](double a, double b) { return std::uniform_real_distribution<double>(a, b)(rng); };
+
+        unsigned frameNum = std::max((int)std::round(sc.lengthSec * sc.fs), 1);
+        InputData id_;
+        id_.fs = sc.fs;
+        id_.initial_mub = sc.mub;
+        id_.initial_up.assign(frameNum, 0.0);
+        id_.initial_ua.assign(frameNum, 0.0);
+        std::vector<FujisakiCommand> cmds;
+
+        // Phrase commands: impulses
+        for (double t = uniform(0.0, 0.3); t * sc.fs < frameNum; t += sc.phraseIntervalSec * uniform(0.5, 1.5))
+        {
+            unsigned frame = (unsigned)(t * sc.fs);
+            double amplitude = uniform(0.2, 0.8);
+            id_.initial_up[frame] = amplitude * sc.fs;
+            cmds.push_back(FujisakiCommand(CMD_PHRASE, (double)frame / sc.fs, (double)frame / sc.fs, amplitude, sc.alpha));
+        }
+
+        // Accent commands: rectangles separated by 1 frame at least
+        unsigned onset = (unsigned)(uniform(0.1, 0.3) * sc.fs);
+        while (onset + 2 < frameNum)
+        {
+            unsigned offset = std::min(onset + std::max((unsigned)(uniform(0.1, 0.4) * sc.fs), 2u), frameNum);
+            double amplitude = uniform(0.1, 0.6);
+            std::fill(id_.initial_ua.begin() + onset, id_.initial_ua.begin() + offset, amplitude);
+            cmds.push_back(FujisakiCommand(CMD_ACCENT, (double)onset / sc.fs, (double)offset / sc.fs,
+                                           amplitude * (offset - onset) / sc.fs, sc.beta));
+            onset = std::max(onset + (unsigned)(sc.accentIntervalSec * uniform(0.5, 1.5) * sc.fs), offset + 1);
+        }
+        std::sort(cmds.begin(), cmds.end());
+
+        // Observation
+        id_.logf0 = criticalfilter(cmds, sc.mub, sc.fs, frameNum);
+        std::normal_distribution<double> noise(0.0, sc.noiseStd);
+        for (auto &lf0 : id_.logf0) lf0 += noise(rng);
+
+        // Voiced/unvoiced segments with the ratio voicedRatio on average
+        id_.vuv.assign(frameNum, 0.0);
+        double voicedSec = 0.3;
+        double unvoicedSec = sc.voicedRatio > 0.0 ? voicedSec * (1.0 - sc.voicedRatio) / sc.voicedRatio : 1e20;
+        double t = uniform(0.0, 2.0 * unvoicedSec);
+        while (t * sc.fs < frameNum)
+        {
+            double tEnd = t + voicedSec * uniform(0.3, 1.7);
+            for (unsigned i = (unsigned)(t * sc.fs); i < frameNum && i < tEnd * sc.fs; i++) id_.vuv[i] = 1.0;
+            t = tEnd + unvoicedSec * uniform(0.3, 1.7);
+        }
+
+        if (commands != nullptr) *commands = cmds;
+        return id_;
+    }
+}
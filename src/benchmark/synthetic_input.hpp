@@ -0,0 +1,31 @@
+// Synthetic input signals for benchmarking
+//
+// Phrase and accent commands are placed at random, filtered by criticalfilter
+// and observed with Gaussian noise, as in demo/generateF0.m.
+
+#pragma once
+#include <vector>
+#include "input_data.hpp"
+#include "fujisaki.hpp"
+
+
+namespace stfmest
+{
+    struct SyntheticInputConfig
+    {
+        double fs = 125.0;
+        double lengthSec = 3.2;
+        double mub = 4.1; // log(60)
+        double alpha = 3.0;
+        double beta = 20.0;
+        double phraseIntervalSec = 2.5; // mean interval of phrase commands
+        double accentIntervalSec = 0.6; // mean interval of accent onsets
+        double noiseStd = 0.02; // of logf0
+        double voicedRatio = 0.7;
+        unsigned seed = 0;
+    };
+
+
+    // The commands used are stored in commands if not nullptr.
+    InputData makeSyntheticInput(const SyntheticInputConfig &sc, std::vector<FujisakiCommand> *commands = nullptr);
+}
@@ -0,0 +1,127 @@
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include "stfmest_c.h"
+#include "estimator.hpp"
+#include "error_codes.hpp"
+
+
+static_assert((int)STFMEST_SIZE_INVALID == stfmest::SIZE_INVALID
+              && (int)STFMEST_INPUT_VECTOR_SIZE_MISMATCH == stfmest::INPUT_VECTOR_SIZE_MISMATCH
+              && (int)STFMEST_TRANSPARAM_VECTOR_SIZE_INVALID == stfmest::TRANSPARAM_VECTOR_SIZE_INVALID
+              && (int)STFMEST_VALUE_INVALID == stfmest::VALUE_INVALID
+              && (int)STFMEST_CONFIG_VALUE_INVALID == stfmest::CONFIG_VALUE_INVALID
+              && (int)STFMEST_TRANSPARAM_PROB_INVALID == stfmest::TRANSPARAM_PROB_INVALID
+              && (int)STFMEST_HMM_SETUP_ERROR == stfmest::HMM_SETUP_ERROR
+              && (int)STFMEST_CONSISTENCY_ERROR == stfmest::CONSISTENCY_ERROR
+              && (int)STFMEST_PHASE_DURATION_MISMATCH == stfmest::PHASE_DURATION_MISMATCH
+              && (int)STFMEST_NOSOLUTION_ERROR == stfmest::NOSOLUTION_ERROR
+              && (int)STFMEST_NOFILE_ERROR == stfmest::NOFILE_ERROR,
+              "status codes differ from FujisakiemError");
+static_assert((int)STFMEST_CMD_PHRASE == stfmest::CMD_PHRASE && (int)STFMEST_CMD_ACCENT == stfmest::CMD_ACCENT,
+              "command types differ from FilterType");
+
+
+struct stfmest_estimator
+{
+    stfmest::Estimator estimator;
+    stfmest_estimator(const stfmest::EstimationConfig &ec, const stfmest::TransParams &tp): estimator(ec, tp) {}
+};
+
+
+static void _setStatus(int *status, int value)
+{
+    if (status != nullptr) *status = value;
+}
+
+
+stfmest_estimator *stfmest_estimator_create(const char *configJson, const char *hmmprobJson, int *status)
+{
+    // No exception may go through the C functions.
+    try
+    {
+        stfmest::EstimationConfig ec = nlohmann::json::parse(configJson);
+        stfmest::TransParams tp = nlohmann::json::parse(hmmprobJson);
+        _setStatus(status, stfmest::NO_ERROR);
+        return new stfmest_estimator(ec, tp);
+    }
+    catch (std::exception &)
+    {
+        _setStatus(status, stfmest::VALUE_INVALID);
+        return nullptr;
+    }
+}
+
+
+static bool _readFile(const char *path, std::string &text)
+{
+    std::ifstream ifs(path);
+    if (!ifs.is_open()) return false;
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    text = ss.str();
+    return true;
+}
+
+
+stfmest_estimator *stfmest_estimator_create_from_files(const char *configPath, const char *hmmprobPath, int *status)
+{
+    std::string configJson, hmmprobJson;
+    if (!_readFile(configPath, configJson) || !_readFile(hmmprobPath, hmmprobJson))
+    {
+        _setStatus(status, stfmest::NOFILE_ERROR);
+        return nullptr;
+    }
+    return stfmest_estimator_create(configJson.c_str(), hmmprobJson.c_str(), status);
+}
+
+
+void stfmest_estimator_destroy(stfmest_estimator *estimator)
+{
+    delete estimator;
+}
+
+
+void stfmest_estimator_release_memory(stfmest_estimator *estimator)
+{
+    if (estimator != nullptr) estimator->estimator.releaseMemory();
+}
+
+
+int stfmest_estimate(stfmest_estimator *estimator, const stfmest_input *input, stfmest_output *output)
+{
+    if (estimator == nullptr || input == nullptr || output == nullptr) return stfmest::VALUE_INVALID;
+    try
+    {
+        std::vector<stfmest::StochasticCommandConstraint> constraints;
+        if (input->constraintsJson != nullptr)
+        {
+            for (auto singleC : nlohmann::json::parse(input->constraintsJson)) constraints.push_back(singleC);
+        }
+
+        stfmest::InputDataView view{input->fs, input->frameNum, input->logf0, input->vuv,
+                                    input->initialUp, input->initialUa, input->initialMub};
+        stfmest::EstimationResult er;
+        int status = estimator->estimator.estimate(view, input->constraintsJson ? &constraints : nullptr, er);
+        if (status != stfmest::NO_ERROR) return status;
+
+        output->commandNum = er.commands.size();
+        output->mub = er.mub;
+        output->rmse = er.rmse;
+        if (output->regeneratedLogf0 != nullptr)
+        {
+            for (std::size_t i=0; i<er.regeneratedlf0.size(); i++) output->regeneratedLogf0[i] = (float)er.regeneratedlf0[i];
+        }
+        if (er.commands.size() > output->commandCapacity) return stfmest::SIZE_INVALID;
+        for (std::size_t i=0; i<er.commands.size(); i++)
+        {
+            const stfmest::FujisakiCommand &c = er.commands[i];
+            output->commands[i] = stfmest_command{(int)c.filtertype, c.onset, c.offset, c.integratedAmplitude, c.omega};
+        }
+        return stfmest::NO_ERROR;
+    }
+    catch (std::exception &)
+    {
+        return stfmest::VALUE_INVALID;
+    }
+}
@@ -0,0 +1,102 @@
+/*
+ * C API of the estimator (see estimator/estimator.hpp)
+ *
+ * The input arrays are read in place and converted once into the buffers
+ * of an estimator kept by the handle, and the results are written into
+ * the caller's buffers. stfmest_estimate() may be called from several
+ * threads with the same handle.
+ */
+
+#ifndef STFMEST_C_H
+#define STFMEST_C_H
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#  ifdef STFMEST_C_EXPORTS
+#    define STFMEST_API __declspec(dllexport)
+#  else
+#    define STFMEST_API __declspec(dllimport)
+#  endif
+#else
+#  define STFMEST_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Status codes (same values as stfmest::FujisakiemError) */
+enum
+{
+    STFMEST_NO_ERROR = 0,
+    STFMEST_SIZE_INVALID = 100, /* also: the command buffer is too small */
+    STFMEST_INPUT_VECTOR_SIZE_MISMATCH = 101,
+    STFMEST_TRANSPARAM_VECTOR_SIZE_INVALID = 102,
+    STFMEST_VALUE_INVALID = 200, /* also: invalid JSON */
+    STFMEST_CONFIG_VALUE_INVALID = 201,
+    STFMEST_TRANSPARAM_PROB_INVALID = 202,
+    STFMEST_HMM_SETUP_ERROR = 300,
+    STFMEST_CONSISTENCY_ERROR = 400,
+    STFMEST_PHASE_DURATION_MISMATCH = 401,
+    STFMEST_NOSOLUTION_ERROR = 500,
+    STFMEST_NOFILE_ERROR = 600
+};
+
+enum
+{
+    STFMEST_CMD_PHRASE = 0,
+    STFMEST_CMD_ACCENT = 1
+};
+
+typedef struct stfmest_estimator stfmest_estimator;
+
+typedef struct
+{
+    int filterType; /* STFMEST_CMD_PHRASE or STFMEST_CMD_ACCENT */
+    double onset; /* sec */
+    double offset; /* sec, == onset for a phrase command */
+    double integratedAmplitude;
+    double omega; /* angular freq. of the filter */
+} stfmest_command;
+
+typedef struct
+{
+    double fs;
+    size_t frameNum;
+    const float *logf0; /* frameNum values each */
+    const float *vuv;
+    const float *initialUp;
+    const float *initialUa;
+    double initialMub;
+    const char *constraintsJson; /* JSON array of the constraints of the accent commands, or NULL */
+} stfmest_input;
+
+typedef struct
+{
+    stfmest_command *commands; /* buffer of commandCapacity commands */
+    size_t commandCapacity;
+    size_t commandNum; /* set to the No. of commands, also if larger than commandCapacity */
+    float *regeneratedLogf0; /* buffer of frameNum values, or NULL */
+    double mub;
+    double rmse;
+} stfmest_output;
+
+/* Makes an estimator from the texts or the files of the config and the HMM
+   probabilities (JSON as for StatisticalFujisakiEst). Returns NULL on failure,
+   with the reason in *status if status is not NULL. */
+STFMEST_API stfmest_estimator *stfmest_estimator_create(const char *configJson, const char *hmmprobJson, int *status);
+STFMEST_API stfmest_estimator *stfmest_estimator_create_from_files(const char *configPath, const char *hmmprobPath, int *status);
+STFMEST_API void stfmest_estimator_destroy(stfmest_estimator *estimator);
+
+/* Frees the memory kept by the estimator for the later inputs. */
+STFMEST_API void stfmest_estimator_release_memory(stfmest_estimator *estimator);
+
+/* Estimates one input. Returns STFMEST_NO_ERROR or a status code. */
+STFMEST_API int stfmest_estimate(stfmest_estimator *estimator, const stfmest_input *input, stfmest_output *output);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
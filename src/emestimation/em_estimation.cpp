@@ -1,5 +1,8 @@
 #include "em_estimation.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
 #include <algorithm>
+#include <cassert>
 #include <cmath>
 #include <iostream>
 #include "fujisaki.hpp"
@@ -12,10 +15,57 @@ using vector = std::vector<Type_>;
 
 namespace stfmest
 {
-    void EmEstimation::loadInputData(InputData id_)
+    const unsigned EmEstimation::INCREMENTAL_EDGE_COST;
+
+
+    void EmEstimation::loadConfig(const EstimationConfig &ec)
+    {
+        config = ec;
+    }
+
+
+    void EmEstimation::loadInputData(const InputData &id_)
     {
         input = id_;
         frameNum = input.logf0.size();
+        profile = EstimationProfile();
+        memoryPeakBytes = 0;
+    }
+
+
+    void EmEstimation::loadInputData(const InputDataView &view)
+    {
+        input.fs = view.fs;
+        input.initial_mub = view.initial_mub;
+        input.logf0.assign(view.logf0, view.logf0 + view.frameNum);
+        input.vuv.assign(view.vuv, view.vuv + view.frameNum);
+        input.initial_up.assign(view.initial_up, view.initial_up + view.frameNum);
+        input.initial_ua.assign(view.initial_ua, view.initial_ua + view.frameNum);
+        frameNum = input.logf0.size();
+        profile = EstimationProfile();
+        memoryPeakBytes = 0;
+    }
+
+
+    void EmEstimation::reset(const InputData &id_)
+    {
+        loadInputData(id_);
+        _clearInputState();
+    }
+
+
+    void EmEstimation::reset(const InputDataView &view)
+    {
+        loadInputData(view);
+        _clearInputState();
+    }
+
+
+    void EmEstimation::_clearInputState()
+    {
+        isWarmStarted = false;
+        flagConst = false;
+        stateConstraints.clear();
     }
 
 
@@ -29,6 +79,23 @@ namespace stfmest
     }
 
 
+    bool EmEstimation::_isHmmReusable()
+    {
+        // The HMM does not depend on the input signal.
+        if (!isHmmPrepared || !(hmmTransparam == transparam)) return false;
+        return hmmConfig.isHmmSerialized == config.isHmmSerialized
+            && hmmConfig.accentBigStateNum == config.accentBigStateNum
+            && (config.isHmmSerialized || hmmConfig.phraseBigStateNum == config.phraseBigStateNum);
+    }
+
+
+    void EmEstimation::loadInitialEstimate(const EstimationResult &er)
+    {
+        initialEstimate = er;
+        isWarmStarted = true;
+    }
+
+
     void EmEstimation::_initHmm()
     {
         if (config.isHmmSerialized)
@@ -40,7 +107,7 @@ namespace stfmest
         else
         {
             // hmm = makeLoopFujisakiHmm(config.phraseBigStateNum, config.accentBigStateNum, transparam, frameNum/2);
-            hmm = makeLoopFujisakiHmm(config.phraseBigStateNum, config.accentBigStateNum, transparam, transparam.r0duration.size());
+            hmm = makeLoopFujisakiHmm(config.phraseBigStateNum, config.accentBigStateNum, transparam, transparam.r0duration.size(), &preparationStatus);
         }
 
         phraseBigStateNum = hmm.countByStateType(STATE_PHRASE);
@@ -72,15 +139,15 @@ namespace stfmest
         vector<BigState> bigstates = hmm.getBigStates();
 
         // Calculate stateNum
-        vector<unsigned> bigstatehead; // bigstatehead[i] = first small state corresponding to (i+1)th big state
-        vector<unsigned> bigstatelen; // bigstatelen[i] = No. of small states corresponding to (i+1)th big state
+        bigStateHead.clear();
+        bigStateLen.clear();
         for (auto bs : bigstates)
         {
-            bigstatehead.push_back(stateNum);
+            bigStateHead.push_back(stateNum);
             unsigned len_tmp = bs.getSmallStateNum();
             stateNum += len_tmp;
-            bigstatelen.push_back(len_tmp);
-            // std::cout << bigstatehead.back() << "=>" << bigstatelen.back() << std::endl;
+            bigStateLen.push_back(len_tmp);
+            // std::cout << bigStateHead.back() << "=>" << bigStateLen.back() << std::endl;
         }
         smallStates.resize(stateNum);
         // std::cout << "Small state num fixed: " << stateNum << std::endl;
@@ -92,11 +159,11 @@ namespace stfmest
 
             SmallState ss(bigstates[i_bs].getAttribute(), static_cast<int>(i_bs));
 
-            for (unsigned i_ss=0; i_ss<bigstatelen[i_bs]; i_ss++){
+            for (unsigned i_ss=0; i_ss<bigStateLen[i_bs]; i_ss++){
                 
-                unsigned iSmallNow = bigstatehead[i_bs] + i_ss;
+                unsigned iSmallNow = bigStateHead[i_bs] + i_ss;
 
-                if (i_ss < bigstatelen[i_bs] - 1)
+                if (i_ss < bigStateLen[i_bs] - 1)
                 {
                     transProbLog[iSmallNow][iSmallNow+1] = 0.0;
                     ss.forwardConnects = {iSmallNow+1};
@@ -113,10 +180,10 @@ namespace stfmest
                         double transProbTmp = nextBig.second;
                         vector<double> durationDist = bigstates[nextBigSt].getDurationDist();
 
-                        for (unsigned itrNext=0; itrNext<bigstatelen[nextBigSt]; itrNext++)
+                        for (unsigned itrNext=0; itrNext<bigStateLen[nextBigSt]; itrNext++)
                         {
-                            unsigned iSmallNext = bigstatehead[nextBigSt] + itrNext;
-                            double durationProbTmp = durationDist[bigstatelen[nextBigSt] - 1 - itrNext];
+                            unsigned iSmallNext = bigStateHead[nextBigSt] + itrNext;
+                            double durationProbTmp = durationDist[bigStateLen[nextBigSt] - 1 - itrNext];
                             if (durationProbTmp <= 0.0) continue;
 
                             ss.forwardConnects.push_back(iSmallNext);
@@ -129,11 +196,11 @@ namespace stfmest
         }
 
         // isStarting
-        smallStates[bigstatehead[hmm.getInitialState()]].isStarting = true;
+        smallStates[bigStateHead[hmm.getInitialState()]].isStarting = true;
 
         // isEnding
         unsigned finalss = hmm.getFinalState();
-        smallStates[bigstatehead[finalss] + bigstatelen[finalss] - 1].isEnding = true;
+        smallStates[bigStateHead[finalss] + bigStateLen[finalss] - 1].isEnding = true;
 
         // backwardConnects
         for (unsigned i_from=0; i_from<stateNum; i_from++)
@@ -143,13 +210,32 @@ namespace stfmest
                 smallStates[i_to].backwardConnects.push_back(i_from);
             }
         }
+
+        smallToBigState.resize(stateNum);
+        for (unsigned i_st=0; i_st<stateNum; i_st++) smallToBigState[i_st] = smallStates[i_st].bigstateId;
+
+        // Flatten backwardConnects for the Viterbi kernel
+        backwardEdgeHead.assign(1, 0u);
+        backwardEdgeFrom.clear();
+        backwardEdgeLogProb.clear();
+        for (unsigned i_to=0; i_to<stateNum; i_to++)
+        {
+            for (auto i_from : smallStates[i_to].backwardConnects)
+            {
+                backwardEdgeFrom.push_back(i_from);
+                backwardEdgeLogProb.push_back(transProbLog[i_from][i_to]);
+            }
+            backwardEdgeHead.push_back(backwardEdgeFrom.size());
+        }
     }
 
 
     void EmEstimation::_initReachableStateInfo()
     {
         
-        isReachable = vector<vector<bool> >(frameNum, vector<bool>(stateNum, true));
+        assignMatrix(isReachable, frameNum, stateNum, true);
+        stateFrameWindow.assign(stateNum, std::make_pair(0u, frameNum));
+        windowedStates.clear();
         startingpoints.clear();
         endpoints.clear();
 
@@ -182,11 +268,28 @@ namespace stfmest
     }
 
 
+    void EmEstimation::_restrictStateFrames(unsigned smallstatenum, unsigned frameBegin, unsigned frameEnd)
+    {
+        std::pair<unsigned, unsigned> &window = stateFrameWindow[smallstatenum];
+        if (window.first == 0 && window.second == frameNum) windowedStates.push_back(smallstatenum);
+        window.first = std::max(window.first, frameBegin);
+        window.second = std::max(window.first, std::min(window.second, frameEnd));
+    }
+
+
     void EmEstimation::_updateReachableStateInfo()
     {
         startingpoints.clear();
         endpoints.clear();
 
+        // Small states are unreachable out of their frame windows
+        for (auto i_st : windowedStates)
+        {
+            const std::pair<unsigned, unsigned> &window = stateFrameWindow[i_st];
+            for (unsigned i_fr=0; i_fr<window.first; i_fr++) isReachable[i_fr][i_st] = false;
+            for (unsigned i_fr=window.second; i_fr<frameNum; i_fr++) isReachable[i_fr][i_st] = false;
+        }
+
         // Start forward search
         for (unsigned i_fr=1; i_fr<frameNum; i_fr++)
         {
@@ -237,103 +340,337 @@ namespace stfmest
     }
 
 
+    void EmEstimation::_updateReachableStateInfoIncremental(const vector<std::pair<unsigned, unsigned> > &removedCells)
+    {
+        // Edges checked around the removed cells, compared with the cells visited by the full sweep
+        unsigned long long edgeNum = 0;
+        for (const auto &cell : removedCells)
+        {
+            edgeNum += smallStates[cell.second].forwardConnects.size() + smallStates[cell.second].backwardConnects.size();
+        }
+        for (auto i_st : windowedStates)
+        {
+            const std::pair<unsigned, unsigned> &window = stateFrameWindow[i_st];
+            unsigned long long cellNum = 0;
+            for (unsigned i_fr=0; i_fr<window.first; i_fr++) cellNum += isReachable[i_fr][i_st];
+            for (unsigned i_fr=window.second; i_fr<frameNum; i_fr++) cellNum += isReachable[i_fr][i_st];
+            edgeNum += cellNum * (smallStates[i_st].forwardConnects.size() + smallStates[i_st].backwardConnects.size());
+        }
+        if (edgeNum * INCREMENTAL_EDGE_COST > (unsigned long long)frameNum * stateNum)
+        {
+            for (const auto &cell : removedCells) isReachable[cell.first][cell.second] = false;
+            _updateReachableStateInfo();
+            return;
+        }
+
+        // As isReachable was consistent, only the cells next to the removed ones can lose
+        // all their previous (next) cells, frame by frame in the forward (backward) search.
+        reachabilitySeeds.assign(removedCells.begin(), removedCells.end());
+        std::sort(reachabilitySeeds.begin(), reachabilitySeeds.end());
+        removedLog.clear();
+        isCandidate.assign(stateNum, 0);
+        candidateStates.clear();
+
+        // Forward search; removedLog gets the removed cells in the order of the frames.
+        std::size_t i_seed = 0;
+        std::size_t prevBegin = 0, prevEnd = 0; // cells removed at the previous frame
+        for (unsigned i_fr=0; i_fr<frameNum; i_fr++)
+        {
+            std::size_t begin = removedLog.size();
+            auto remove = [&](unsigned i_st)
+            {
+                if (!isReachable[i_fr][i_st]) return;
+                isReachable[i_fr][i_st] = false;
+                removedLog.push_back(std::make_pair(i_fr, i_st));
+            };
+            for (; i_seed<reachabilitySeeds.size() && reachabilitySeeds[i_seed].first == i_fr; i_seed++)
+            {
+                remove(reachabilitySeeds[i_seed].second);
+            }
+            // Small states are unreachable out of their frame windows
+            for (auto i_st : windowedStates)
+            {
+                if (i_fr < stateFrameWindow[i_st].first || i_fr >= stateFrameWindow[i_st].second) remove(i_st);
+            }
+
+            for (std::size_t i=prevBegin; i<prevEnd; i++)
+            {
+                for (auto st_next : smallStates[removedLog[i].second].forwardConnects)
+                {
+                    if (!isReachable[i_fr][st_next] || isCandidate[st_next]) continue;
+                    isCandidate[st_next] = 1;
+                    candidateStates.push_back(st_next);
+                }
+            }
+            for (auto i_st : candidateStates)
+            {
+                isCandidate[i_st] = 0;
+                bool isSupported = false;
+                for (auto st_prev : smallStates[i_st].backwardConnects)
+                {
+                    if (isReachable[i_fr-1][st_prev])
+                    {
+                        isSupported = true;
+                        break;
+                    }
+                }
+                if (!isSupported) remove(i_st);
+            }
+            candidateStates.clear();
+            prevBegin = begin;
+            prevEnd = removedLog.size();
+        }
+
+        // Backward search from the cells removed at the next frame by either search
+        std::size_t i_log = removedLog.size();
+        backwardRemoved.clear();
+        for (int i_fr=frameNum-2; i_fr>=0; i_fr--)
+        {
+            auto addPrevious = [&](unsigned st_removed)
+            {
+                for (auto st_prev : smallStates[st_removed].backwardConnects)
+                {
+                    if (!isReachable[i_fr][st_prev] || isCandidate[st_prev]) continue;
+                    isCandidate[st_prev] = 1;
+                    candidateStates.push_back(st_prev);
+                }
+            };
+            for (; i_log>0 && removedLog[i_log-1].first > (unsigned)i_fr; i_log--)
+            {
+                if (removedLog[i_log-1].first == (unsigned)i_fr + 1) addPrevious(removedLog[i_log-1].second);
+            }
+            for (auto i_st : backwardRemoved) addPrevious(i_st);
+            backwardRemoved.clear();
+
+            for (auto i_st : candidateStates)
+            {
+                isCandidate[i_st] = 0;
+                bool isSupported = false;
+                for (auto st_next : smallStates[i_st].forwardConnects)
+                {
+                    if (isReachable[i_fr+1][st_next])
+                    {
+                        isSupported = true;
+                        break;
+                    }
+                }
+                if (!isSupported)
+                {
+                    isReachable[i_fr][i_st] = false;
+                    backwardRemoved.push_back(i_st);
+                }
+            }
+            candidateStates.clear();
+        }
+
+        startingpoints.clear();
+        endpoints.clear();
+        for (unsigned i_st=0; i_st<stateNum; i_st++)
+        {
+            if (isReachable[0][i_st]) startingpoints.push_back(i_st);
+            if (isReachable[frameNum-1][i_st]) endpoints.push_back(i_st);
+        }
+    }
+
+
     void EmEstimation::_initEmParameters()
     {
+        // Gp/Ga are recalculated only if the filter or fs is changed, or the input is longer.
+        unsigned kernelFrameNum = Gp.size();
+        if (alpha != config.defaultAlpha || beta != config.defaultBeta || kernelFs != input.fs)
+        {
+            kernelFrameNum = 0;
+        }
         alpha = config.defaultAlpha;
         beta = config.defaultBeta;
-        Gp = vector<double>(frameNum, 0.0);
-        Ga = vector<double>(frameNum, 0.0);
+        kernelFs = input.fs;
+        if (kernelFrameNum < frameNum)
+        {
+            Gp.resize(frameNum);
+            Ga.resize(frameNum);
+            for (unsigned i_fr=kernelFrameNum; i_fr<frameNum; i_fr++)
+            {
+                double tsec = (double)i_fr / input.fs;
+                Gp[i_fr] = (Real)(impulse_response(alpha, tsec) / input.fs);
+                Ga[i_fr] = (Real)(impulse_response(beta, tsec) / input.fs);
+            }
+        }
+
         invsigma2_p = 1.0 / config.defaultSigmap2;
         invsigma2_a = 1.0 / config.defaultSigmaa2;
-        invsigma2_n = vector<double>(frameNum, 0.0);
+        invsigma2_n.resize(frameNum);
 
         for (unsigned i_fr=0; i_fr<frameNum; i_fr++)
         {
-            double tsec = (double)i_fr / input.fs;
-            Gp[i_fr] = impulse_response(alpha, tsec) / input.fs;
-            Ga[i_fr] = impulse_response(beta, tsec) / input.fs;
             invsigma2_n[i_fr] = input.vuv[i_fr] > config.zeroThreshold
                                 ? 1.0 / config.defaultSigman2_voiced
                                 : 1.0 / config.defaultSigman2_unvoiced;
         }
+
+        // Constant terms of the update of up/ua
+        ScratchScope<double> scope(scratch);
+        std::vector<double> &weightedlf0 = scratch.acquire(frameNum);
+        for (unsigned i_fr=0; i_fr<frameNum; i_fr++) weightedlf0[i_fr] = input.logf0[i_fr] * invsigma2_n[i_fr];
+        logf0Corr_p.assign(frameNum, 0.0);
+        logf0Corr_a.assign(frameNum, 0.0);
+        addFilteredExcitationTransposed(weightedlf0, alpha, input.fs, logf0Corr_p);
+        addFilteredExcitationTransposed(weightedlf0, beta, input.fs, logf0Corr_a);
+    }
+
+    void EmEstimation::_updateEmissionTable()
+    {
+        // The output prob. depends only on the frame and the big state.
+        unsigned bigStateNum = hmm.getStateNum();
+        emissionTable.resize((size_t)frameNum * bigStateNum);
+        for (unsigned i_fr=0; i_fr<frameNum; i_fr++)
+        {
+            double upNow = up[i_fr];
+            double uaNow = ua[i_fr];
+            Real *row = &emissionTable[(size_t)i_fr * bigStateNum];
+            for (unsigned i_big=0; i_big<bigStateNum; i_big++)
+            {
+                row[i_big] = (Real)(-0.5 * (upNow - Cp[i_big]) * (upNow - Cp[i_big]) * invsigma2_p
+                    -0.5 * (uaNow - Ca[i_big]) * (uaNow - Ca[i_big]) * invsigma2_a);
+            }
+        }
     }
 
-    void EmEstimation::_viterbiAlgorithm()
+
+    std::vector<std::vector<double> > EmEstimation::getEmissionProb()
+    {
+        if (emissionTable.size() < (size_t)frameNum * hmm.getStateNum()) return std::vector<std::vector<double> >();
+        std::vector<std::vector<double> > emissionProbLog(frameNum, std::vector<double>(stateNum));
+        for (unsigned i_fr=0; i_fr<frameNum; i_fr++)
+        {
+            for (unsigned i_st=0; i_st<stateNum; i_st++) emissionProbLog[i_fr][i_st] = _emissionProbLog(i_fr, i_st);
+        }
+        return emissionProbLog;
+    }
+
+
+    int EmEstimation::_viterbiAlgorithm()
     {
+        STFMEST_TRACE_SCOPE("viterbiAlgorithm");
+        _updateEmissionTable();
+
         // Optimal probs.
-        delta = vector<vector<double> >(frameNum, vector<double>(stateNum, -config.inf));
+        assignMatrix(delta, frameNum, stateNum, (Real)-config.inf);
         // previous small state for each frame/state.
-        s_before = vector<vector<unsigned> >(frameNum, vector<unsigned>(stateNum, stateNum));
+        assignMatrix(s_before, frameNum, stateNum, stateNum);
+
+        // delta is kept relative to its maximum at each frame
+        // so that the scores stay small enough for single precision.
+        // deltaOffset is the sum of the subtracted maxima.
+        double deltaOffset = 0.0;
 
         // Setting delta at initial frame
-        for (unsigned i_st : startingpoints) delta[0][i_st] = _emissionProbLog(0, i_st);
+        for (unsigned i_st : startingpoints) delta[0][i_st] = (Real)_emissionProbLog(0, i_st);
+        deltaOffset += _normalizeDelta(0);
         
         // The Viterbi Algorithm(main part)
+        _viterbiForward(deltaOffset);
+
+        // Calculating  isReachable, s_before, delta  finished.
+        unsigned optimalLastState = stateNum;
+        double deltaMax = 0.0;
+        for (unsigned i_st=0; i_st<stateNum; i_st++)
+        {
+            if (smallStates[i_st].isEnding && isReachable[frameNum-1][i_st])
+            {
+                if (optimalLastState == stateNum || delta[frameNum-1][i_st] > deltaMax)
+                {
+                    optimalLastState = i_st;
+                    deltaMax = delta[frameNum-1][i_st];
+                }
+            }
+        }
+        
+        if (optimalLastState == stateNum)
+        {
+            std::cerr << "Viterbi failed." << std::endl;
+            return NOSOLUTION_ERROR;
+        }
+        s[frameNum-1] = optimalLastState;
+        for (int i_fr=frameNum-2; i_fr>=0; i_fr--) s[i_fr] = s_before[i_fr+1][s[i_fr+1]];
+
+        return NO_ERROR;
+    }
+
+
+    void EmEstimation::_viterbiForward(double &deltaOffset)
+    {
+        unsigned long long statesVisited = 0, edgesRelaxed = 0;
         for (unsigned i_fr=1; i_fr<frameNum; i_fr++)
         {
+            const vector<Real> &deltaPrev = delta[i_fr-1];
+            const vector<bool> &isReachablePrev = isReachable[i_fr-1];
+
             for (unsigned i_st = 0; i_st<stateNum; i_st++)
             {
                 if (!isReachable[i_fr][i_st]) continue;
+                ++statesVisited;
 
                 double edgeMax = 0.0;
                 unsigned tempPreviousState = stateNum;
-                for (auto st_prev : smallStates[i_st].backwardConnects)
+                auto relax = [&](unsigned st_prev, double edge_tmp)
                 {
-                    if (!isReachable[i_fr-1][st_prev]) continue;
-                    double edge_tmp = delta[i_fr-1][st_prev] + _transitionProbLog(st_prev, i_st);
-
-                    if (tempPreviousState == stateNum || edge_tmp - edgeMax > std::abs(edgeMax) * config.zeroThreshold)
+                    ++edgesRelaxed;
+                    if (tempPreviousState == stateNum || edge_tmp - edgeMax > std::abs(edgeMax + deltaOffset) * config.zeroThreshold)
                     {
                         edgeMax = edge_tmp;
                         tempPreviousState = st_prev;
                     }
+                };
+
+                // Edges are relaxed in the order of backwardConnects to keep the tie-breaking.
+                for (unsigned i_edge=backwardEdgeHead[i_st], edgeEnd=backwardEdgeHead[i_st+1]; i_edge<edgeEnd; i_edge++)
+                {
+                    unsigned st_prev = backwardEdgeFrom[i_edge];
+                    if (isReachablePrev[st_prev]) relax(st_prev, deltaPrev[st_prev] + backwardEdgeLogProb[i_edge]);
                 }
+
                 if (tempPreviousState != stateNum)
                 {
                     s_before[i_fr][i_st] = tempPreviousState;
-                    delta[i_fr][i_st] = edgeMax + _emissionProbLog(i_fr, i_st);
+                    delta[i_fr][i_st] = (Real)(edgeMax + _emissionProbLog(i_fr, i_st));
                 }
             }
+            deltaOffset += _normalizeDelta(i_fr);
         }
-        // Calculating  isReachable, s_before, delta  finished.
-        unsigned optimalLastState = stateNum;
-        double deltaMax = 0.0;
+        profile.statesVisited += statesVisited;
+        profile.edgesRelaxed += edgesRelaxed;
+    }
+
+
+    double EmEstimation::_normalizeDelta(unsigned frame)
+    {
+        double frameMax = -config.inf;
         for (unsigned i_st=0; i_st<stateNum; i_st++)
         {
-            if (smallStates[i_st].isEnding && isReachable[frameNum-1][i_st])
-            {
-                if (optimalLastState == stateNum || delta[frameNum-1][i_st] > deltaMax)
-                {
-                    optimalLastState = i_st;
-                    deltaMax = delta[frameNum-1][i_st];
-                }
-            }
+            if (isReachable[frame][i_st] && delta[frame][i_st] > frameMax) frameMax = delta[frame][i_st];
         }
-        
-        if (optimalLastState == stateNum)
+        if (frameMax <= -config.inf) return 0.0;
+
+        for (unsigned i_st=0; i_st<stateNum; i_st++)
         {
-            std::cerr << "Viterbi failed." << std::endl;
-            exit(1);
+            if (isReachable[frame][i_st]) delta[frame][i_st] = (Real)(delta[frame][i_st] - frameMax);
         }
-        s[frameNum-1] = optimalLastState;
-        for (int i_fr=frameNum-2; i_fr>=0; i_fr--) s[i_fr] = s_before[i_fr+1][s[i_fr+1]];
-
-        return;
+        return frameMax;
     }
 
 
     void EmEstimation::_initEmVariables()
     {
-        lambda_p = vector<vector<double> >(frameNum, vector<double>(frameNum, 0.0));
-        lambda_a = vector<vector<double> >(frameNum, vector<double>(frameNum, 0.0));
-        s = vector<unsigned>(frameNum, stateNum);
+        assignMatrix(lambda_p, frameNum, frameNum, (Real)0.0);
+        assignMatrix(lambda_a, frameNum, frameNum, (Real)0.0);
+        s.assign(frameNum, stateNum);
         if (config.isHardEmEnabled)
         {
             gamma.clear();
         }
         else
         {
-            gamma = vector<vector<double> >(frameNum, vector<double>(frameNum, 0.0));
+            assignMatrix(gamma, frameNum, frameNum, (Real)0.0);
         }
         up.clear();
         // up = input.initial_up;
@@ -412,27 +749,218 @@ namespace stfmest
                 }
             }
         }*/
+
+        if (isWarmStarted) _initEmVariablesFromResult();
         return;
     }
 
 
+    void EmEstimation::_initEmVariablesFromResult()
+    {
+        const EstimationResult &er = initialEstimate;
+        mub = er.mub;
+
+        // Cp/Ca are reusable only if the HMM has the same big states.
+        if (er.Cp.size() == Cp.size() && er.Ca.size() == Ca.size())
+        {
+            Cp = er.Cp;
+            Ca = er.Ca;
+        }
+
+        // The state path is found again by the first E step from up/ua.
+        if (er.up.size() == frameNum && er.ua.size() == frameNum)
+        {
+            up = er.up;
+            ua = er.ua;
+        }
+        else if (er.bigs.size() == frameNum && er.Cp.size() == Cp.size() && er.Ca.size() == Ca.size())
+        {
+            // Rebuild up/ua from the path: Cp (Ca) in the phrase (accent) states
+            for (unsigned i_fr=0; i_fr<frameNum; i_fr++)
+            {
+                int attribute = er.bigs[i_fr] >= 0 && (unsigned)er.bigs[i_fr] < hmm.getStateNum()
+                                ? hmm.getBigState(er.bigs[i_fr]).getAttribute() : STATE_BEGIN;
+                up[i_fr] = attribute == STATE_PHRASE ? Cp[er.bigs[i_fr]] : config.regularizerOffset;
+                ua[i_fr] = attribute == STATE_ACCENT ? Ca[er.bigs[i_fr]] : config.regularizerOffset;
+            }
+        }
+        else
+        {
+            // Rebuild up/ua from the commands
+            up.assign(frameNum, config.regularizerOffset);
+            ua.assign(frameNum, config.regularizerOffset);
+            for (auto comm : er.commands)
+            {
+                int onsetFrame = std::max((int)std::round(comm.onset * input.fs), 0);
+                int offsetFrame = std::min((int)std::round(comm.offset * input.fs), (int)frameNum);
+                if (offsetFrame <= onsetFrame) continue;
+                double amplitude = comm.integratedAmplitude / (comm.offset - comm.onset);
+                std::vector<double> &ux = comm.filtertype == CMD_PHRASE ? up : ua;
+                for (int i_fr=onsetFrame; i_fr<offsetFrame; i_fr++)
+                {
+                    ux[i_fr] = std::max(amplitude, config.regularizerOffset);
+                }
+            }
+        }
+    }
+
+
+    unsigned EmEstimation::prepareHmm()
+    {
+        Timer t;
+        if (!_isHmmReusable())
+        {
+            isHmmPrepared = false;
+            preparationStatus = NO_ERROR;
+            _initHmm();
+            profile.initHmm += t.lap();
+            if (preparationStatus != NO_ERROR)
+            {
+                stateNum = 0;
+                smallStates.clear();
+                return stateNum;
+            }
+            // std::cout << "HMM initialized." << std::endl;
+            _initSmallStates();
+            profile.initSmallStates += t.lap();
+            // std::cout << "ss initialized." << std::endl;
+            isHmmPrepared = true;
+            hmmConfig = config;
+            hmmTransparam = transparam;
+        }
+        else
+        {
+            // Branch No.'s are set in _initHmm()
+            config.phraseBranchNum = hmmConfig.phraseBranchNum;
+            config.accentBranchNum = hmmConfig.accentBranchNum;
+        }
+        return stateNum;
+    }
+
+
     void EmEstimation::emPreparation()
     {
-        _initHmm();
-        // std::cout << "HMM initialized." << std::endl;
-        _initSmallStates();
-        // std::cout << "ss initialized." << std::endl;
+        STFMEST_TRACE_SCOPE("emPreparation");
+        preparationStatus = NO_ERROR;
+        if (frameNum < 1
+            || input.logf0.size() != frameNum
+            || input.vuv.size() != frameNum
+            || input.initial_up.size() != frameNum
+            || input.initial_ua.size() != frameNum)
+        {
+            preparationStatus = INPUT_VECTOR_SIZE_MISMATCH;
+            return;
+        }
+        prepareHmm();
+        if (preparationStatus != NO_ERROR) return;
+        Timer t;
         _initReachableStateInfo();
         _updateReachableStateInfo();
+        profile.reachability += t.lap();
         // std::cout << "rsi initialized." << std::endl;
         _initEmParameters();
         // std::cout << "EM parameters initialized." << std::endl;
         _initEmVariables();
         // std::cout << "EM variables initialized." << std::endl;
-        if (constraintProbLog.size() != frameNum
-            || constraintProbLog[0].size() != stateNum)
-            constraintProbLog = vector<vector<double> >(frameNum, vector<double>(stateNum, 0.0));
+        _clearConstraintProbLog();
         // std::cout << "constraintProbLog initialized." << std::endl;
+        profile.initEm += t.lap();
+        _updateMemoryPeak();
+    }
+
+
+    MemoryUsage EmEstimation::getMemoryUsage()
+    {
+        MemoryUsage mu;
+        mu.bufferBytes["input"] = reservedBytes(input.logf0) + reservedBytes(input.vuv)
+                                  + reservedBytes(input.initial_up) + reservedBytes(input.initial_ua);
+        mu.bufferBytes["smallStates"] = reservedBytes(smallStates);
+        for (const auto &ss : smallStates)
+        {
+            mu.bufferBytes["smallStates"] += reservedBytes(ss.forwardConnects) + reservedBytes(ss.backwardConnects);
+        }
+        mu.bufferBytes["transProbLog"] = reservedBytes(transProbLog);
+        mu.bufferBytes["backwardEdges"] = reservedBytes(backwardEdgeHead) + reservedBytes(backwardEdgeFrom)
+                                          + reservedBytes(backwardEdgeLogProb)
+                                          + reservedBytes(smallToBigState) + reservedBytes(bigStateHead)
+                                          + reservedBytes(bigStateLen);
+        mu.bufferBytes["isReachable"] = reservedBytes(isReachable);
+        mu.bufferBytes["delta"] = reservedBytes(delta);
+        mu.bufferBytes["s_before"] = reservedBytes(s_before);
+        mu.bufferBytes["emissionTable"] = reservedBytes(emissionTable);
+        mu.bufferBytes["lambda_p"] = reservedBytes(lambda_p);
+        mu.bufferBytes["lambda_a"] = reservedBytes(lambda_a);
+        mu.bufferBytes["gamma"] = reservedBytes(gamma);
+        mu.bufferBytes["frameVectors"] = reservedBytes(Gp) + reservedBytes(Ga) + reservedBytes(invsigma2_n)
+                                         + reservedBytes(logf0Corr_p) + reservedBytes(logf0Corr_a)
+                                         + reservedBytes(s) + reservedBytes(up) + reservedBytes(ua)
+                                         + reservedBytes(Cp) + reservedBytes(Ca)
+                                         + reservedBytes(startingpoints) + reservedBytes(endpoints);
+        mu.bufferBytes["constraints"] = reservedBytes(constraintIdOfState) + reservedBytes(stateConstraints)
+                                        + reservedBytes(stateFrameWindow) + reservedBytes(windowedStates)
+                                        + reservedBytes(reachabilitySeeds) + reservedBytes(removedLog)
+                                        + reservedBytes(isCandidate) + reservedBytes(candidateStates)
+                                        + reservedBytes(backwardRemoved);
+        for (const auto &sc : stateConstraints) mu.bufferBytes["constraints"] += reservedBytes(sc.logprob);
+        mu.bufferBytes["scratch"] = scratch.reservedBytes() + commandScratch.reservedBytes();
+
+        for (const auto &b : mu.bufferBytes) mu.totalBytes += b.second;
+        mu.peakBytes = std::max(memoryPeakBytes, mu.totalBytes);
+        return mu;
+    }
+
+
+    void EmEstimation::_updateMemoryPeak()
+    {
+        memoryPeakBytes = getMemoryUsage().peakBytes;
+    }
+
+
+    unsigned long long EmEstimation::estimateMemoryBytes(unsigned frameNum, unsigned stateNum, unsigned bigStateNum, const EstimationConfig &ec)
+    {
+        unsigned long long n = frameNum;
+        unsigned long long bytes = 0;
+        bytes += 2 * n * n * sizeof(Real); // lambda_p, lambda_a
+        if (!ec.isHardEmEnabled) bytes += n * n * sizeof(Real); // gamma
+        bytes += n * stateNum * (sizeof(Real) + sizeof(unsigned)) + n * stateNum / 8; // delta, s_before, isReachable
+        bytes += n * (3 * sizeof(std::vector<Real>) + sizeof(std::vector<unsigned>) + sizeof(std::vector<bool>)); // rows
+        bytes += n * bigStateNum * sizeof(Real); // emissionTable
+        bytes += n * 24 * sizeof(double); // input, kernels, up/ua, scratch etc.
+        bytes += (unsigned long long)stateNum * 4 * sizeof(unsigned); // windows, constraint ids etc.
+        return bytes;
+    }
+
+
+    unsigned long long EmEstimation::estimateMemoryBytes(unsigned frameNum_)
+    {
+        prepareHmm();
+        MemoryUsage mu = getMemoryUsage();
+        unsigned long long hmmBytes = mu.bufferBytes["smallStates"] + mu.bufferBytes["transProbLog"]
+                                      + mu.bufferBytes["backwardEdges"];
+        return hmmBytes + estimateMemoryBytes(frameNum_, stateNum, hmm.getStateNum(), config);
+    }
+
+
+    void EmEstimation::_clearConstraintProbLog()
+    {
+        flagConst = false;
+        constraintIdOfState.assign(stateNum, -1);
+        stateConstraints.clear();
+    }
+
+
+    void EmEstimation::_setConstraintProbLog(unsigned smallstatenum, unsigned frameBegin, const std::vector<double> &logprob)
+    {
+        // Overwrite the constraint of the small state if already set.
+        if (constraintIdOfState[smallstatenum] < 0)
+        {
+            constraintIdOfState[smallstatenum] = stateConstraints.size();
+            stateConstraints.push_back(StateConstraint());
+        }
+        StateConstraint &sc = stateConstraints[constraintIdOfState[smallstatenum]];
+        sc.frameBegin = frameBegin;
+        sc.logprob = logprob;
+        flagConst = true;
     }
 
 
@@ -444,19 +972,19 @@ namespace stfmest
         // any resultant lambda^p and lambda^a's must NOT be zero,
         // so we add the artificial regularization term with keeping the condition (78).
 
+        // denominators[k] = mub + sum_{l<=k} (Gp[k-l] up[l] + Ga[k-l] ua[l])
+        ScratchScope<double> scope(scratch);
+        std::vector<double> &denominators = scratch.acquire(frameNum, mub);
+        addFilteredExcitation(up, alpha, input.fs, denominators);
+        addFilteredExcitation(ua, beta, input.fs, denominators);
+
         for (unsigned k=0; k<frameNum; k++)
         {
-            double denominator = 0.0;
-            for (unsigned ll=0; ll<=k; ll++) // '<=', not '<'
-            {
-                denominator += Gp[k-ll] * up[ll] + Ga[k-ll] * ua[ll]; // + 2.0 * config.regularizerOffset;
-            }
-            denominator += mub;
-
+            double denominator = denominators[k];
             for (unsigned l=0; l<=k; l++)
             {
-                lambda_p[k][l] = (Gp[k-l] * up[l] /*+ config.regularizerOffset*/) / denominator;
-                lambda_a[k][l] = (Ga[k-l] * ua[l] /*+ config.regularizerOffset*/) / denominator;
+                lambda_p[k][l] = (Real)((Gp[k-l] * up[l] /*+ config.regularizerOffset*/) / denominator);
+                lambda_a[k][l] = (Real)((Ga[k-l] * ua[l] /*+ config.regularizerOffset*/) / denominator);
             }
         }
         return true;
@@ -465,24 +993,23 @@ namespace stfmest
 
     bool EmEstimation::_updateUpUaHard()
     {
-        _u_update_function_hard(up, Gp, Cp, lambda_p, invsigma2_p);
-        _u_update_function_hard(ua, Ga, Ca, lambda_a, invsigma2_a);
+        _u_update_function_hard(up, Gp, logf0Corr_p, Cp, lambda_p, invsigma2_p);
+        _u_update_function_hard(ua, Ga, logf0Corr_a, Ca, lambda_a, invsigma2_a);
         return true;
     }
 
-    inline bool EmEstimation::_u_update_function_hard(vector<double> &ux, const vector<double> &Gx, const vector<double> &Cx, const vector<vector<double> > &lambda_x, double invsigma2_x)
+    inline bool EmEstimation::_u_update_function_hard(vector<double> &ux, const vector<Real> &Gx, const vector<double> &logf0Corr_x, const vector<double> &Cx, const vector<vector<Real> > &lambda_x, double invsigma2_x)
     {
         for (unsigned l=0; l<frameNum; l++) {
 
             double denominator = invsigma2_x;
-            double numerator = Cx[smallStates[s[l]].bigstateId] * invsigma2_x;
+            double numerator = Cx[smallStates[s[l]].bigstateId] * invsigma2_x + logf0Corr_x[l];
 
             for (unsigned k=l; k<frameNum; k++)
             {
                 if (lambda_x[k][l] >= config.zeroThreshold){
-                    denominator += Gx[k-l] * Gx[k-l] * invsigma2_n[k] / lambda_x[k][l];
+                    denominator += (double)Gx[k-l] * Gx[k-l] * invsigma2_n[k] / lambda_x[k][l];
                 }
-                numerator += (input.logf0[k]/* - mub*/) * Gx[k-l] * invsigma2_n[k];
             }
             // if (denominator > config.zeroThreshold)
             // {
@@ -505,8 +1032,9 @@ namespace stfmest
     {
         unsigned bigStateNum = hmm.getStateNum();
 
-        vector<double> numerator(bigStateNum, 0.0);
-        vector<double> denominator(bigStateNum, 0.0);
+        ScratchScope<double> scope(scratch);
+        vector<double> &numerator = scratch.acquire(bigStateNum, 0.0);
+        vector<double> &denominator = scratch.acquire(bigStateNum, 0.0);
 
         for (unsigned i_fr=0; i_fr<frameNum; ++i_fr)
         {
@@ -530,6 +1058,7 @@ namespace stfmest
 
     void EmEstimation::_hardMstep()
     {
+        STFMEST_TRACE_SCOPE("hardMstep");
         for (int iter=0; iter<config.mstepUpdateNumPerIteration; iter++)
         {
             _updateLambda();
@@ -538,29 +1067,60 @@ namespace stfmest
         }
     }
 
-    void EmEstimation::_iterateHardEm()
+    int EmEstimation::_iterateHardEm()
     {
-        for (int iter=0; iter<config.iterationNum; iter++)
+        int iterationNum = config.iterationNum;
+        if (isWarmStarted && config.warmStartIterationNum >= 0) iterationNum = config.warmStartIterationNum;
+
+#ifndef NDEBUG
+        std::size_t scratchGrowthNum = 0;
+        std::size_t commandScratchGrowthNum = 0;
+#endif
+        // Reserved so that the iterations do not allocate for the profile.
+        profile.viterbiAlgorithm.reserve(profile.viterbiAlgorithm.size() + iterationNum);
+        profile.hardMstep.reserve(profile.hardMstep.size() + iterationNum);
+        profile.perturbCommands.reserve(profile.perturbCommands.size() + iterationNum);
+        Timer t;
+        for (int iter=0; iter<iterationNum; iter++)
         {
+            t.start();
             // std::cout << "Viterbi " << iter << std::endl;
-            _viterbiAlgorithm();
+            int status = _viterbiAlgorithm();
+            if (status != NO_ERROR) return status;
+            profile.viterbiAlgorithm.push_back(t.lap());
             // std::cout << "hard M " << iter << std::endl;
             _hardMstep();
+            profile.hardMstep.push_back(t.lap());
             // std::cout << "Perturb " << iter << std::endl;
             _perturbCommands();
+            profile.perturbCommands.push_back(t.lap());
+            if (iter == 0) _updateMemoryPeak(); // The buffers do not grow after the first iteration.
+#ifndef NDEBUG
+            // The pools are grown only in the first iteration.
+            if (iter == 0)
+            {
+                scratchGrowthNum = scratch.getGrowthNum();
+                commandScratchGrowthNum = commandScratch.getGrowthNum();
+            }
+            assert(scratch.getGrowthNum() == scratchGrowthNum);
+            assert(commandScratch.getGrowthNum() == commandScratchGrowthNum);
+#endif
         }
+        return NO_ERROR;
     }
 
 
-    bool EmEstimation::launch()
+    int EmEstimation::launch()
     {
-        _iterateHardEm();
-        return true;
+        return _iterateHardEm();
     }
 
 
     int EmEstimation::_validateBeforeEm()
     {
+        // Errors found in emPreparation()
+        if (preparationStatus != NO_ERROR) return preparationStatus;
+
         // Check vectors' size
         if (frameNum < 1
             || input.logf0.size() != frameNum
@@ -627,7 +1187,7 @@ namespace stfmest
 
 
         // Check preparation
-        if (Gp.size() != frameNum || Ga.size() != frameNum || invsigma2_n.size() != frameNum) return CONSISTENCY_ERROR;
+        if (Gp.size() < frameNum || Ga.size() < frameNum || invsigma2_n.size() != frameNum) return CONSISTENCY_ERROR;
 
         // No solution
         if (startingpoints.size() < 1 || endpoints.size() < 1) return NOSOLUTION_ERROR;
@@ -636,9 +1196,9 @@ namespace stfmest
         return NO_ERROR;
     }
 
-    std::vector<FujisakiCommand> EmEstimation::_getCommands()
+    int EmEstimation::_getCommands(std::vector<FujisakiCommand> &cmds)
     {
-        std::vector<FujisakiCommand> cmds;
+        cmds.clear();
         int bigstatenum_before = hmm.getInitialState();
         int bigstatenum = bigstatenum_before;
         bool isCommandOnNow = false;
@@ -675,7 +1235,7 @@ namespace stfmest
                             break;
                         default:
                             std::cerr << "Invalid attribute " << oldattr << " is set for the state." << std::endl;
-                            exit(1);
+                            return HMM_SETUP_ERROR;
                     }
                     isCommandOnNow = false;
                 }
@@ -701,23 +1261,21 @@ namespace stfmest
                         break;
                     default:
                         std::cerr << "Invalid attribute " << newattr << " is set for the state." << std::endl;
-                        exit(1);
+                        return HMM_SETUP_ERROR;
                 }
             }
             bigstatenum_before = bigstatenum;        
         }
-        return cmds;
+        return NO_ERROR;
     }
 
 
     inline double EmEstimation::_ux_observedlf0_distance(std::vector<double> &up_, std::vector<double> &ua_)
     {
-        std::vector<double> lf0regen(frameNum, mub);
-        for (unsigned k=0; k<frameNum; k++) {
-            for (unsigned l=0; l<=k; l++) {
-                lf0regen[k] += up_[l] * Gp[k-l] + ua_[l] * Ga[k-l];
-            }
-        }
+        ScratchScope<double> scope(scratch);
+        std::vector<double> &lf0regen = scratch.acquire(frameNum, mub);
+        addFilteredExcitation(up_, alpha, input.fs, lf0regen);
+        addFilteredExcitation(ua_, beta, input.fs, lf0regen);
 
         double logdist2 = 0.0;
         for (unsigned k=0; k<frameNum; k++)
@@ -728,12 +1286,15 @@ namespace stfmest
     }
 
 
-    EstimationResult EmEstimation::getResult()
+    int EmEstimation::getResult(EstimationResult &er)
     {
+        STFMEST_TRACE_SCOPE("getResult");
+        Timer t;
 
-        _viterbiAlgorithm();
+        er = EstimationResult();
+        int status = _viterbiAlgorithm();
+        if (status != NO_ERROR) return status;
 
-        EstimationResult er;
         // Derive mup&mua
         er.mup = std::vector<double>(frameNum, 0.0);
         er.mua = std::vector<double>(frameNum, 0.0);
@@ -747,15 +1308,30 @@ namespace stfmest
 
         er.Cp = Cp;
         er.Ca = Ca;
+        er.up = up;
+        er.ua = ua;
         er.bigs = std::vector<int>(frameNum);
         for (unsigned i=0; i<er.bigs.size(); i++) er.bigs[i] = smallStates[s[i]].bigstateId;
 
-        er.commands = _getCommands();
-        er.regeneratedlf0 = criticalfilter(er.commands, mub, input.fs, frameNum);
-        er.rmse = rmse(input.logf0, er.regeneratedlf0, input.vuv, config.zeroThreshold);
+        status = _getCommands(er.commands);
+        if (status != NO_ERROR) return status;
+        er.fs = input.fs;
+        er.regeneratedlf0 = criticalfilter(er.commands, mub, input.fs, frameNum, &status);
+        if (status != NO_ERROR) return status;
+        er.rmse = rmse(input.logf0, er.regeneratedlf0, input.vuv, config.zeroThreshold, &status);
+        if (status != NO_ERROR) return status;
         er.voicedFrameNum = 0;
         for (auto vuv : input.vuv) if (vuv > config.zeroThreshold) ++(er.voicedFrameNum);
-        return er;
+
+        profile.getResult = t.stop();
+        profile.memory = getMemoryUsage();
+        memoryPeakBytes = profile.memory.peakBytes;
+        if (isProfileEnabled)
+        {
+            er.hasProfile = true;
+            er.profile = profile;
+        }
+        return NO_ERROR;
     }
 
     inline double Ylikelihood (
@@ -763,8 +1339,8 @@ namespace stfmest
         const std::vector<double> &invsigma2_n,
         const std::vector<double> &up,
         const std::vector<double> &ua,
-        const std::vector<double> &Gp,
-        const std::vector<double> &Ga,
+        const std::vector<Real> &Gp,
+        const std::vector<Real> &Ga,
         double mub
     )
     {
@@ -774,7 +1350,7 @@ namespace stfmest
         
         for (unsigned k=0; k<nFrame; k++)
         {
-            for (unsigned l=0; l<=k; l++) yRegen[k] += up[l] * Gp[k-l] + ua[l] * Ga[k-l];
+            for (unsigned l=0; l<=k; l++) yRegen[k] += up[l] * (double)Gp[k-l] + ua[l] * (double)Ga[k-l];
             yRegen[k] += mub;
             ans += -(y[k] - yRegen[k]) * (y[k] - yRegen[k]) * 0.5 * invsigma2_n[k];
         }
@@ -783,7 +1359,15 @@ namespace stfmest
 
     void EmEstimation::_perturbCommands()
     {
-        std::vector<FujisakiCommand> commands = _getCommands();
+        STFMEST_TRACE_SCOPE("perturbCommands");
+        ScratchScope<double> scope(scratch);
+        ScratchScope<FujisakiCommand> commandScope(commandScratch);
+
+        // At most one command starts at each frame.
+        std::vector<FujisakiCommand> &commands = commandScratch.acquire(0, FujisakiCommand(), frameNum);
+        if (_getCommands(commands) != NO_ERROR) return;
+        std::vector<double> &up_tmp = scratch.acquire(frameNum);
+        std::vector<double> &ua_tmp = scratch.acquire(frameNum);
 
         for (unsigned i=0, n=commands.size(); i<n; i++)
         {
@@ -799,8 +1383,6 @@ namespace stfmest
 
             int frame_comm_start_ref = (int)std::round(commands[i].onset * input.fs);
             int frame_comm_end_ref = (int)std::round(commands[i].offset * input.fs);
-            std::vector<double> up_tmp(frameNum);
-            std::vector<double> ua_tmp(frameNum);
 
             for (int fr = - config.perturbSearchWidth; fr <= config.perturbSearchWidth; fr++)
             {
@@ -824,6 +1406,7 @@ namespace stfmest
                     ua_tmp[j + fr] = ua[j];
                 }
                 double dist_tmp = _ux_observedlf0_distance(up_tmp, ua_tmp);
+                ++profile.perturbationCandidates;
                 if (dist_tmp < minDivergence)
                 {
                     minDivergence = dist_tmp;
@@ -10,6 +10,12 @@
 #include "fujisaki.hpp"
 #include "small_state.hpp"
 #include "estimation_result.hpp"
+#include "estimation_profile.hpp"
+#include "memory_usage.hpp"
+#include "precision.hpp"
+#include "matrix_buffer.hpp"
+#include "scratch_pool.hpp"
+#include "error_codes.hpp"
 
 
 namespace stfmest
@@ -23,6 +29,10 @@ namespace stfmest
         TransParams transparam;
 
         Hmm hmm;
+        bool isHmmPrepared = false; // hmm and small states are made from hmmConfig & hmmTransparam
+        int preparationStatus = NO_ERROR; // error code found in emPreparation(), returned by validate()
+        EstimationConfig hmmConfig;
+        TransParams hmmTransparam;
         unsigned phraseBigStateNum;
         unsigned accentBigStateNum;
         std::vector<int> phraseNumToBigState; // ph...[i] == big state no. of (i+1)th phrase-on big state
@@ -32,101 +42,177 @@ namespace stfmest
     protected:
         unsigned stateNum; // No. of small states generated in this->hmm
         std::vector<SmallState> smallStates;
+        std::vector<unsigned> bigStateHead; // bigStateHead[i] = first small state corresponding to (i+1)th big state
+        std::vector<unsigned> bigStateLen; // bigStateLen[i] = No. of small states corresponding to (i+1)th big state
         std::vector<std::map<int, double> > transProbLog; // log trans.prob. betw. small states
 
+        // backwardConnects of all small states and their log trans. probs.
+        // flattened: edges to i-th small state are [backwardEdgeHead[i], backwardEdgeHead[i+1]).
+        std::vector<unsigned> backwardEdgeHead;
+        std::vector<unsigned> backwardEdgeFrom;
+        std::vector<double> backwardEdgeLogProb;
+
 
         // Preparation for executing the EM algorithm
     protected:
+        // The matrices indexed by frame keep their rows for longer inputs (see matrix_buffer.hpp).
         std::vector<std::vector<bool> > isReachable; // Permit on each state at each frame, or not
+        std::vector<std::pair<unsigned, unsigned> > stateFrameWindow; // Each small state is reachable only in frames [first, second)
+        std::vector<unsigned> windowedStates; // Small states whose stateFrameWindow is narrower than the whole signal
+        void _restrictStateFrames(unsigned smallstatenum, unsigned frameBegin, unsigned frameEnd);
     private:
         std::vector<unsigned> startingpoints; // The No's of small states candidate for the initial state.
         std::vector<unsigned> endpoints;
         
-        double alpha;
-        double beta;
-        std::vector<double> Gp;
-        std::vector<double> Ga;
+        double alpha = 0.0; // for which Gp/Ga are calculated, with kernelFs
+        double beta = 0.0;
+        double kernelFs = 0.0; // fs for which Gp/Ga are calculated
+        std::vector<Real> Gp; // Calculated up to the longest input so far
+        std::vector<Real> Ga;
         double invsigma2_p;
         double invsigma2_a;
         std::vector<double> invsigma2_n;
+        std::vector<double> logf0Corr_p; // logf0Corr_p[l] = sum_{k>=l} logf0[k] Gp[k-l] invsigma2_n[k]
+        std::vector<double> logf0Corr_a;
 
 
         // Parameters used in EM algorithm.
-        std::vector<std::vector<double> > lambda_p;
-        std::vector<std::vector<double> > lambda_a;
+        std::vector<std::vector<Real> > lambda_p;
+        std::vector<std::vector<Real> > lambda_a;
         std::vector<unsigned> s; // for Hard EM
-        std::vector<std::vector<double> > gamma; // for Soft EM
+        std::vector<std::vector<Real> > gamma; // for Soft EM
         std::vector<double> up;
         std::vector<double> ua;
         double mub;
         std::vector<double> Cp;
         std::vector<double> Ca;
-        std::vector<std::vector<double> > delta;
+        std::vector<std::vector<Real> > delta; // relative to the max. at each frame
+
+        // Temporary vectors in the EM iterations
+        ScratchPool<double> scratch;
+        ScratchPool<FujisakiCommand> commandScratch;
+
+        // Previous result to start from (warm start)
+        bool isWarmStarted = false;
+        EstimationResult initialEstimate;
         std::vector<std::vector<unsigned> > s_before;
 
+        // Profile of the current input
+    protected:
+        bool isProfileEnabled = false; // profile is attached to the result iff true
+        EstimationProfile profile;
+        unsigned long long memoryPeakBytes = 0;
+        void _updateMemoryPeak();
+
         // external constraint 
     protected:
-        std::vector<std::vector<double> > constraintProbLog;
+        // Log prob. added to the output prob. of one small state
+        // at frames [frameBegin, frameBegin + logprob.size()).
+        struct StateConstraint
+        {
+            unsigned frameBegin;
+            std::vector<double> logprob;
+        };
+        bool flagConst = false; // true iff any constraint is set
+        std::vector<int> constraintIdOfState; // index of stateConstraints for each small state, or -1
+        std::vector<StateConstraint> stateConstraints;
+        void _setConstraintProbLog(unsigned smallstatenum, unsigned frameBegin, const std::vector<double> &logprob);
+        void _clearConstraintProbLog();
+    private:
+        // emissionTable[frame * hmm.getStateNum() + bigstate]: log output prob.
+        // without constraint, updated at each _viterbiAlgorithm().
+        std::vector<Real> emissionTable;
+        std::vector<unsigned> smallToBigState; // == smallStates[i].bigstateId
 
 
         // For Viterbi algorithm
-        inline double _emissionProbLog(unsigned frame, unsigned smallstatenum)
-        {
-            return _emissionProbLogDefault(frame, smallstatenum) + constraintProbLog[frame][smallstatenum];
-        }
-        
-        inline double _emissionProbLogDefault(unsigned frame, unsigned smallstatenum)
-        {
-            int bigstatenum = smallStates[smallstatenum].bigstateId;
-            double mup = Cp[bigstatenum];
-            double mua = Ca[bigstatenum];
-            return -0.5 * (up[frame] - mup) * (up[frame] - mup) * invsigma2_p 
-                -0.5 * (ua[frame] - mua) * (ua[frame] - mua) * invsigma2_a;
-        }
+        void _updateEmissionTable();
 
-        inline double _transitionProbLog(unsigned state_prev, unsigned state_now)
+        inline double _emissionProbLog(unsigned frame, unsigned smallstatenum)
         {
-            // if (transProbLog[state_prev].count(state_now))
-                return transProbLog[state_prev][state_now];
+            double logprob = emissionTable[frame * hmm.getStateNum() + smallToBigState[smallstatenum]];
+            if (flagConst && constraintIdOfState[smallstatenum] >= 0)
+            {
+                const StateConstraint &sc = stateConstraints[constraintIdOfState[smallstatenum]];
+                if (frame >= sc.frameBegin && frame - sc.frameBegin < sc.logprob.size())
+                {
+                    logprob += sc.logprob[frame - sc.frameBegin];
+                }
+            }
+            return logprob;
         }
 
+        bool _isHmmReusable();
         void _initHmm();
         void _initSmallStates();
         void _initReachableStateInfo();
     protected:
         void _updateReachableStateInfo();
+        // Same as _updateReachableStateInfo() if isReachable was consistent
+        // except for removedCells (frame, small state) and the frame windows.
+        // Falls back to the full sweep if the removed cells have too many edges.
+        void _updateReachableStateInfoIncremental(const std::vector<std::pair<unsigned, unsigned> > &removedCells);
+    private:
+        static const unsigned INCREMENTAL_EDGE_COST = 4; // cost of checking an edge relative to a cell of the full sweep
+        std::vector<std::pair<unsigned, unsigned> > reachabilitySeeds; // removedCells sorted by frame
+        std::vector<std::pair<unsigned, unsigned> > removedLog; // cells removed in the forward search
+        std::vector<char> isCandidate; // by small state, for the current frame
+        std::vector<unsigned> candidateStates;
+        std::vector<unsigned> backwardRemoved; // cells removed at the next frame in the backward search
+    protected:
+        // Phases of an EM iteration
+        int _viterbiAlgorithm(); // E step: update s
+        void _hardMstep(); // M step
+        void _perturbCommands();
     private:
         void _initEmParameters();
         void _initEmVariables();
+        void _initEmVariablesFromResult();
         int _validateBeforeEm();
-        void _iterateHardEm();
+        int _iterateHardEm();
+        void _clearInputState();
 
         // E step
-        void _viterbiAlgorithm(); // update s
+        void _viterbiForward(double &deltaOffset); // fill delta & s_before
+        double _normalizeDelta(unsigned frame); // returns the subtracted max.
 
         // M step
-        void _hardMstep();
-
         bool _updateLambda();
         bool _updateUpUaHard();
-        inline bool _u_update_function_hard(std::vector<double> &ux, const std::vector<double> &Gx, const std::vector<double> &Cx, const std::vector<std::vector<double> > &lambda_x, double invsigma2_x);
+        inline bool _u_update_function_hard(std::vector<double> &ux, const std::vector<Real> &Gx, const std::vector<double> &logf0Corr_x, const std::vector<double> &Cx, const std::vector<std::vector<Real> > &lambda_x, double invsigma2_x);
         bool _updateCpCaHard();
         inline bool _c_update_function_hard(std::vector<double> &Cx, const std::vector<double> &ux, double invsigma2_x, int attribute);
 
-        std::vector<FujisakiCommand> _getCommands();
-        void _perturbCommands();
+        int _getCommands(std::vector<FujisakiCommand> &cmds);
         inline double _ux_observedlf0_distance(std::vector<double> &up_, std::vector<double> &ua_);
 
     public:
         EmEstimation(EstimationConfig ec): config(ec) {}
-        void loadInputData(InputData id_); 
+        void loadConfig(const EstimationConfig &ec);
+        void loadInputData(const InputData &id_); 
+        void loadInputData(const InputDataView &view); // converted into the input buffers only
+        void reset(const InputData &id_); // Start over for a new input, reusing the allocated memory.
+        void reset(const InputDataView &view);
         void loadTransparams(TransParams tp, bool regularize);
+        void loadInitialEstimate(const EstimationResult &er); // Start EM from a previous result of the same input.
         inline TransParams getTransParams() { return transparam; }
+        inline void enableProfile(bool enable) { isProfileEnabled = enable; }
+        unsigned prepareHmm(); // Make the HMM for the config & trans. params if not yet. Returns No. of small states.
         void emPreparation(); // Preparation for EM algorithm
         inline int validate(){ return _validateBeforeEm(); }
-        bool launch(); // Launch EM.
-        EstimationResult getResult();
+        int launch(); // Launch EM. Returns an error code (see error_codes.hpp).
+        int getResult(EstimationResult &er);
 
         std::vector<SmallState> getSmallStates() { return smallStates; }
+        // Dense frameNum x stateNum matrix of the log output probs. (incl. constraints)
+        // at the last E step; empty before it.
+        std::vector<std::vector<double> > getEmissionProb();
+
+        // Memory accounting (see memory_usage.hpp)
+        MemoryUsage getMemoryUsage();
+        // Estimated bytes of the buffers for an input of frameNum frames, excl. the HMM itself.
+        static unsigned long long estimateMemoryBytes(unsigned frameNum, unsigned stateNum, unsigned bigStateNum, const EstimationConfig &ec);
+        // Same with the prepared HMM, incl. the HMM.
+        unsigned long long estimateMemoryBytes(unsigned frameNum_);
     };
 }
\ No newline at end of file
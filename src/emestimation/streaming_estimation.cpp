@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "streaming_estimation.hpp"
+#include "trace.hpp"
+
+
+namespace stfmest
+{
+    StreamingEstimation::StreamingEstimation(const EstimationConfig &ec, const TransParams &tp, const StreamingConfig &sc,
+                                             double fs, double initial_mub):
+        em(ec), config(ec), transparam(tp), fs(fs), initial_mub(initial_mub), mub(initial_mub)
+    {
+        if (sc.windowIterationNum >= 0)
+        {
+            config.warmStartIterationNum = sc.windowIterationNum;
+            em.loadConfig(config);
+        }
+        windowFrameNum = (unsigned)std::round(sc.windowSec * fs);
+        lagFrameNum = (unsigned)std::round(sc.lagSec * fs);
+        hopFrameNum = std::max((unsigned)std::round(sc.hopSec * fs), 1u);
+        allowedTimeLagSec = sc.allowedTimeLagSec;
+        if (windowFrameNum <= lagFrameNum + hopFrameNum)
+        {
+            std::cerr << "The streaming window must be longer than lag + hop." << std::endl;
+            configStatus = CONFIG_VALUE_INVALID;
+        }
+        lastEmitted.resize(2);
+        lastEmitted[CMD_PHRASE].onset = lastEmitted[CMD_ACCENT].onset = -INFINITY;
+        lastEmitted[CMD_PHRASE].offset = lastEmitted[CMD_ACCENT].offset = -INFINITY;
+    }
+
+
+    int StreamingEstimation::push(const InputData &frames, std::vector<FujisakiCommand> &emitted)
+    {
+        if (configStatus != NO_ERROR) return configStatus;
+        if (frames.vuv.size() != frames.logf0.size()
+            || frames.initial_up.size() != frames.logf0.size()
+            || frames.initial_ua.size() != frames.logf0.size())
+        {
+            return INPUT_VECTOR_SIZE_MISMATCH;
+        }
+        // After a failed estimation the rest of the frames are only buffered.
+        int status = NO_ERROR;
+        for (unsigned i=0; i<frames.logf0.size(); i++)
+        {
+            logf0.push_back(frames.logf0[i]);
+            vuv.push_back(frames.vuv[i]);
+            initial_up.push_back(frames.initial_up[i]);
+            initial_ua.push_back(frames.initial_ua[i]);
+            ++frameNum;
+            ++pendingFrameNum;
+            if (logf0.size() > windowFrameNum)
+            {
+                logf0.pop_front();
+                vuv.pop_front();
+                initial_up.pop_front();
+                initial_ua.pop_front();
+                ++frameBegin;
+            }
+
+            if (status == NO_ERROR && pendingFrameNum >= hopFrameNum && frameNum > lagFrameNum)
+            {
+                status = _estimateWindow();
+                if (status == NO_ERROR) _emit(frameNum - lagFrameNum, emitted);
+            }
+        }
+        return status;
+    }
+
+
+    int StreamingEstimation::finish(std::vector<FujisakiCommand> &emitted)
+    {
+        if (configStatus != NO_ERROR) return configStatus;
+        if (pendingFrameNum > 0 || !hasPrevious)
+        {
+            int status = _estimateWindow();
+            if (status) return status;
+        }
+        _emit(frameNum, emitted);
+        return 0;
+    }
+
+
+    int StreamingEstimation::_estimateWindow()
+    {
+        STFMEST_TRACE_SCOPE("window");
+        InputData window;
+        window.fs = fs;
+        window.initial_mub = initial_mub;
+        window.logf0.assign(logf0.begin(), logf0.end());
+        window.vuv.assign(vuv.begin(), vuv.end());
+        window.initial_up.assign(initial_up.begin(), initial_up.end());
+        window.initial_ua.assign(initial_ua.begin(), initial_ua.end());
+
+        // Responses of the commands before the window, negligible after 50 / omega
+        double windowBeginSec = frameBegin / fs;
+        while (!carried.empty() && (windowBeginSec - carried.front().offset) * carried.front().omega > 50.0)
+        {
+            carried.pop_front();
+        }
+        std::vector<double> response(window.logf0.size(), 0.0);
+        for (auto c : carried)
+        {
+            if (c.onset >= windowBeginSec) continue; // estimated again in this window
+            c.onset -= windowBeginSec;
+            c.offset -= windowBeginSec;
+            synthesizer.add(c, fs, response);
+        }
+        for (unsigned i=0; i<window.logf0.size(); i++) window.logf0[i] -= response[i];
+        em.reset(window);
+
+        // Start from the previous window where they overlap.
+        if (hasPrevious)
+        {
+            EstimationResult warm;
+            unsigned shift = frameBegin - previousBegin;
+            warm.mub = previous.mub;
+            warm.Cp = previous.Cp;
+            warm.Ca = previous.Ca;
+            for (unsigned i=0; i<window.logf0.size(); i++)
+            {
+                bool isOld = shift + i < previous.up.size();
+                warm.up.push_back(isOld ? previous.up[shift + i] : window.initial_up[i]);
+                warm.ua.push_back(isOld ? previous.ua[shift + i] : window.initial_ua[i]);
+            }
+            em.loadInitialEstimate(warm);
+        }
+
+        em.loadTransparams(transparam, !config.enableLimitedDurationExtension);
+        em.emPreparation();
+        int status = em.validate();
+        if (status && config.enableLimitedDurationExtension)
+        {
+            em.loadTransparams(transparam, true);
+            em.emPreparation();
+            status = em.validate();
+        }
+        if (status) return status;
+
+        status = em.launch();
+        if (status) return status;
+        status = em.getResult(previous);
+        if (status)
+        {
+            hasPrevious = false; // previous is cleared
+            return status;
+        }
+        previousBegin = frameBegin;
+        hasPrevious = true;
+        mub = previous.mub;
+        pendingFrameNum = 0;
+        return 0;
+    }
+
+
+    void StreamingEstimation::_emit(unsigned long long frameEnd, std::vector<FujisakiCommand> &emitted)
+    {
+        double shiftSec = previousBegin / fs;
+        std::vector<FujisakiCommand> commands = previous.commands;
+        std::sort(commands.begin(), commands.end());
+        for (auto c : commands)
+        {
+            c.onset += shiftSec;
+            c.offset += shiftSec;
+            double onsetFrame = std::round(c.onset * fs);
+            if (onsetFrame < committedFrame || onsetFrame >= frameEnd) continue;
+
+            // Already emitted from an earlier window
+            const FujisakiCommand &last = lastEmitted[c.filtertype];
+            bool isOverlapping = c.filtertype == CMD_ACCENT ? c.onset < last.offset
+                                                            : c.onset - last.onset < allowedTimeLagSec;
+            if (isOverlapping) continue;
+
+            lastEmitted[c.filtertype] = c;
+            carried.push_back(c);
+            emitted.push_back(c);
+            ++emittedNum;
+        }
+        committedFrame = std::max(committedFrame, frameEnd);
+    }
+}
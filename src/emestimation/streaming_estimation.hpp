@@ -0,0 +1,81 @@
+// Estimation of a signal arriving frame by frame
+//
+// The EM algorithm is repeated on a sliding window of the latest frames
+// every hop, starting from the estimate of the previous window.
+// A command is emitted once its onset is older than the lag, i.e. once
+// the Viterbi path there is fixed for the rest of the window (fixed-lag
+// decision), so the latency and the memory are bounded by the window.
+// The responses of the emitted commands starting before the window are
+// subtracted from its logf0.
+
+#pragma once
+#include <deque>
+#include <vector>
+#include "em_estimation.hpp"
+#include "fujisaki_synthesizer.hpp"
+
+
+namespace stfmest
+{
+    struct StreamingConfig
+    {
+        double windowSec = 6.0; // frames estimated together
+        double lagSec = 1.0; // commands starting earlier than this before the latest frame are emitted
+        double hopSec = 0.5; // the window is estimated again after this
+        double allowedTimeLagSec = 0.1; // phrase commands closer than this to an emitted one are the same
+        int windowIterationNum = 5; // EM iterations of a window started from the previous one (negative: warmStartIterationNum)
+    };
+
+
+    class StreamingEstimation
+    {
+        EmEstimation em;
+        EstimationConfig config;
+        TransParams transparam;
+        double fs;
+        double initial_mub;
+        unsigned windowFrameNum;
+        unsigned lagFrameNum;
+        unsigned hopFrameNum;
+        double allowedTimeLagSec;
+        int configStatus = NO_ERROR; // CONFIG_VALUE_INVALID if the window is too short
+
+        // Latest frames, at most windowFrameNum
+        std::deque<double> logf0;
+        std::deque<double> vuv;
+        std::deque<double> initial_up;
+        std::deque<double> initial_ua;
+        unsigned long long frameBegin = 0; // stream frame of the first buffered frame
+        unsigned long long frameNum = 0; // frames pushed so far
+        unsigned long long committedFrame = 0; // commands starting before this are emitted
+        unsigned pendingFrameNum = 0; // frames pushed after the last estimation
+
+        bool hasPrevious = false; // previous window estimated
+        EstimationResult previous; // in the time of its window
+        unsigned long long previousBegin = 0;
+        double mub;
+        std::vector<FujisakiCommand> lastEmitted; // last command of each type, for overlapping ones
+        std::deque<FujisakiCommand> carried; // emitted commands whose responses may reach the window
+        FujisakiSynthesizer synthesizer;
+        unsigned emittedNum = 0;
+
+        int _estimateWindow();
+        void _emit(unsigned long long frameEnd, std::vector<FujisakiCommand> &emitted);
+
+    public:
+        StreamingEstimation(const EstimationConfig &ec, const TransParams &tp, const StreamingConfig &sc,
+                            double fs, double initial_mub);
+        // Appends the frames of frames.logf0/vuv/initial_up/initial_ua.
+        // Commands found final are appended to emitted, in the time [sec] from the stream start.
+        // Returns an error code (0 if OK, see error_codes.hpp). If a window fails, the rest
+        // of the frames are still buffered, and the window is estimated again at the next hop.
+        int push(const InputData &frames, std::vector<FujisakiCommand> &emitted);
+        // Estimates the remaining frames at the end of the stream.
+        int finish(std::vector<FujisakiCommand> &emitted);
+
+        inline unsigned long long getFrameNum() const { return frameNum; }
+        inline double getMub() const { return mub; }
+        inline unsigned getEmittedNum() const { return emittedNum; }
+        inline MemoryUsage getMemoryUsage() { return em.getMemoryUsage(); }
+    };
+}
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include "estimator.hpp"
+#include "error_codes.hpp"
+
+
+namespace stfmest
+{
+    Estimator::Estimator(const EstimationConfig &ec, const TransParams &tp):
+        config(ec), transparam(tp)
+    {
+    }
+
+
+    void Estimator::enableProfile(bool enable)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        isProfileEnabled = enable;
+    }
+
+
+    EstimationConfig Estimator::configFor(const std::vector<StochasticCommandConstraint> *constraints) const
+    {
+        EstimationConfig ec = config;
+        if (constraints != nullptr)
+        {
+            ec.isHmmSerialized = true;
+            ec.accentBigStateNum = constraints->size();
+        }
+        return ec;
+    }
+
+
+    std::unique_ptr<Estimator::Slot> Estimator::_acquireSlot()
+    {
+        std::unique_ptr<Slot> slot;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!idleSlots.empty())
+            {
+                slot = std::move(idleSlots.back());
+                idleSlots.pop_back();
+            }
+        }
+        if (!slot) slot.reset(new Slot());
+        return slot;
+    }
+
+
+    void Estimator::_releaseSlot(std::unique_ptr<Slot> slot)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        idleSlots.push_back(std::move(slot));
+    }
+
+
+    int Estimator::estimate(const InputData &id_, const std::vector<StochasticCommandConstraint> *constraints,
+                            EstimationResult &result, const EstimationResult *initialEstimate)
+    {
+        // The EM preparation assumes the sizes.
+        unsigned frameNum = id_.logf0.size();
+        if (frameNum < 1 || id_.vuv.size() != frameNum
+            || id_.initial_up.size() != frameNum || id_.initial_ua.size() != frameNum)
+        {
+            return INPUT_VECTOR_SIZE_MISMATCH;
+        }
+
+        std::unique_ptr<Slot> slot = _acquireSlot();
+        int status = _estimate(*slot, id_, constraints, result, initialEstimate);
+        _releaseSlot(std::move(slot));
+        return status;
+    }
+
+
+    int Estimator::estimate(const InputDataView &view, const std::vector<StochasticCommandConstraint> *constraints,
+                            EstimationResult &result, const EstimationResult *initialEstimate)
+    {
+        if (view.frameNum < 1 || view.frameNum > 4294967295u
+            || !view.logf0 || !view.vuv || !view.initial_up || !view.initial_ua)
+        {
+            return INPUT_VECTOR_SIZE_MISMATCH;
+        }
+
+        std::unique_ptr<Slot> slot = _acquireSlot();
+        int status = _estimate(*slot, view, constraints, result, initialEstimate);
+        _releaseSlot(std::move(slot));
+        return status;
+    }
+
+
+    int Estimator::prepare(EmEstimationConstrained &em, const InputData &id_,
+                           const std::vector<StochasticCommandConstraint> *constraints,
+                           const EstimationResult *initialEstimate)
+    {
+        unsigned frameNum = id_.logf0.size();
+        if (frameNum < 1 || id_.vuv.size() != frameNum
+            || id_.initial_up.size() != frameNum || id_.initial_ua.size() != frameNum)
+        {
+            return INPUT_VECTOR_SIZE_MISMATCH;
+        }
+
+        // Both tries on em
+        EmEstimationConstrained *prepared = nullptr;
+        return _prepare([&em](bool) -> EmEstimationConstrained & { return em; },
+                        id_, constraints, initialEstimate, prepared);
+    }
+
+
+    template <class Input, class EstimatorOf>
+    int Estimator::_prepare(EstimatorOf estimatorOf, const Input &input, const std::vector<StochasticCommandConstraint> *constraints,
+                            const EstimationResult *initialEstimate, EmEstimationConstrained *&em)
+    {
+        EstimationConfig ec = configFor(constraints);
+        bool isProfileEnabled_;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            isProfileEnabled_ = isProfileEnabled;
+        }
+
+        // With the limited duration extension, the trans. probs. are regularized
+        // only if the input cannot be estimated with them as given.
+        int status = NO_ERROR;
+        for (bool regularize : {false, true})
+        {
+            if (!regularize && !ec.enableLimitedDurationExtension) continue;
+            em = &estimatorOf(regularize);
+            em->loadConfig(ec);
+            em->reset(input);
+            em->enableProfile(isProfileEnabled_);
+            if (initialEstimate != nullptr) em->loadInitialEstimate(*initialEstimate);
+            em->loadTransparams(transparam, regularize);
+            em->emPreparation();
+            if (constraints != nullptr) em->imposeStochasticConst(*constraints);
+            status = em->validate();
+            if (status == NO_ERROR) break;
+        }
+        return status;
+    }
+
+
+    template <class Input>
+    int Estimator::_estimate(Slot &slot, const Input &input, const std::vector<StochasticCommandConstraint> *constraints,
+                             EstimationResult &result, const EstimationResult *initialEstimate)
+    {
+        EstimationConfig ec = configFor(constraints);
+        auto estimatorOf = [&slot, &ec](bool regularize) -> EmEstimationConstrained &
+        {
+            std::unique_ptr<EmEstimationConstrained> &estimator = regularize ? slot.emRegularized : slot.em;
+            if (!estimator) estimator.reset(new EmEstimationConstrained(ec));
+            return *estimator;
+        };
+        EmEstimationConstrained *em = nullptr;
+        int status = _prepare(estimatorOf, input, constraints, initialEstimate, em);
+        if (status != NO_ERROR) return status;
+
+        status = em->launch();
+        if (status != NO_ERROR) return status;
+        return em->getResult(result);
+    }
+
+
+    std::vector<std::pair<FilterType, CommandsCoincidenceResult> > Estimator::evaluate(
+        const std::vector<FujisakiCommand> &reference, const EstimationResult &result) const
+    {
+        return evaluateByDP(reference, result.commands, 0.1, config.zeroThreshold);
+    }
+
+
+    unsigned long long Estimator::predictMemoryBytes(unsigned frameNum, const std::vector<StochasticCommandConstraint> *constraints)
+    {
+        EstimationConfig ec = configFor(constraints);
+        std::lock_guard<std::mutex> lock(plannerMtx);
+        if (!planner)
+        {
+            planner.reset(new EmEstimation(ec));
+            plannerRegularized.reset(new EmEstimation(ec));
+        }
+        plannerRegularized->loadConfig(ec);
+        plannerRegularized->loadTransparams(transparam, true);
+        unsigned long long bytes = plannerRegularized->estimateMemoryBytes(frameNum);
+        if (ec.enableLimitedDurationExtension)
+        {
+            planner->loadConfig(ec);
+            planner->loadTransparams(transparam, false);
+            bytes = std::max(bytes, planner->estimateMemoryBytes(frameNum));
+        }
+        return bytes;
+    }
+
+
+    unsigned long long Estimator::getRetainedBytes()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        unsigned long long bytes = 0;
+        for (auto &slot : idleSlots)
+        {
+            if (slot->em) bytes += slot->em->getMemoryUsage().totalBytes;
+            if (slot->emRegularized) bytes += slot->emRegularized->getMemoryUsage().totalBytes;
+        }
+        return bytes;
+    }
+
+
+    void Estimator::releaseMemory()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        idleSlots.clear();
+    }
+}
@@ -0,0 +1,95 @@
+// Estimation of inputs with a fixed config and HMM probabilities
+//
+// Does what StatisticalFujisakiEst does for each input: the serialized HMM
+// for the external constraints, the retry with the regularized trans. probs.,
+// validation and the EM algorithm. estimate() may be called from several
+// threads at once; each call takes an idle estimator from a pool (or makes
+// one), so the HMMs and the buffers are reused by the later calls.
+
+#pragma once
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "input_data.hpp"
+#include "estimation_config.hpp"
+#include "fujisaki.hpp"
+#include "estimation_result.hpp"
+#include "hmm_fujisaki.hpp"
+#include "em_estimation.hpp"
+#include "external_constraint.hpp"
+#include "evaluation.hpp"
+
+
+namespace stfmest
+{
+    class Estimator
+    {
+    public:
+        Estimator(const EstimationConfig &ec, const TransParams &tp);
+
+        // Returns NO_ERROR, or the FujisakiemError by which the input could not be estimated.
+        // constraints: one per accent command (see external_constraint.hpp), or nullptr
+        // initialEstimate: previous result of the same input to start from, or nullptr
+        int estimate(const InputData &id_, const std::vector<StochasticCommandConstraint> *constraints,
+                     EstimationResult &result, const EstimationResult *initialEstimate = nullptr);
+        // Same for the caller's arrays, without copying them but into the estimator's buffers
+        int estimate(const InputDataView &view, const std::vector<StochasticCommandConstraint> *constraints,
+                     EstimationResult &result, const EstimationResult *initialEstimate = nullptr);
+
+        // Prepares em for the input as estimate() does, up to the validation: with configFor(constraints),
+        // and the trans. probs. regularized only if the input cannot be estimated with them as given.
+        // Returns the status of validate(); em->launch() and getResult() finish the estimation.
+        // For inspecting the EM state, e.g. in the tests.
+        int prepare(EmEstimationConstrained &em, const InputData &id_,
+                    const std::vector<StochasticCommandConstraint> *constraints,
+                    const EstimationResult *initialEstimate = nullptr);
+
+        // Commands matched with the reference within 0.1 sec (see evaluation.hpp)
+        std::vector<std::pair<FilterType, CommandsCoincidenceResult> > evaluate(
+            const std::vector<FujisakiCommand> &reference, const EstimationResult &result) const;
+
+        void enableProfile(bool enable);
+
+        // Config used for an input with the constraints
+        EstimationConfig configFor(const std::vector<StochasticCommandConstraint> *constraints) const;
+
+        // Predicted bytes for estimating an input (see EmEstimation::estimateMemoryBytes),
+        // of the larger HMM with/without the regularized trans. probs.
+        unsigned long long predictMemoryBytes(unsigned frameNum, const std::vector<StochasticCommandConstraint> *constraints);
+
+        // Memory kept by the idle estimators
+        unsigned long long getRetainedBytes();
+        // Drops the idle estimators.
+        void releaseMemory();
+
+    private:
+        // Estimators with the trans. probs. as given and regularized
+        struct Slot
+        {
+            std::unique_ptr<EmEstimationConstrained> em;
+            std::unique_ptr<EmEstimationConstrained> emRegularized;
+        };
+
+        EstimationConfig config;
+        TransParams transparam;
+        bool isProfileEnabled = false;
+
+        std::mutex mtx;
+        std::vector<std::unique_ptr<Slot> > idleSlots;
+
+        std::mutex plannerMtx;
+        std::unique_ptr<EmEstimation> planner; // keep the HMM while the config is the same
+        std::unique_ptr<EmEstimation> plannerRegularized;
+
+        std::unique_ptr<Slot> _acquireSlot();
+        void _releaseSlot(std::unique_ptr<Slot> slot);
+        // em: the estimator for the trans. probs. as given (false) or regularized (true)
+        template <class Input, class EstimatorOf>
+        int _prepare(EstimatorOf estimatorOf, const Input &input, const std::vector<StochasticCommandConstraint> *constraints,
+                     const EstimationResult *initialEstimate, EmEstimationConstrained *&em);
+        template <class Input>
+        int _estimate(Slot &slot, const Input &input, const std::vector<StochasticCommandConstraint> *constraints,
+                      EstimationResult &result, const EstimationResult *initialEstimate);
+    };
+}
@@ -1,100 +1,232 @@
 #include "external_constraint.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
-const double M_PI = 3.14159265358979323846;
+#include <limits>
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
 
 
 namespace stfmest
 {
-    std::vector<double> _tmp_calcGmmLogsumexp (
-        double basetime,
-        const std::vector<double> &weights,
-        const std::vector<double> &means,
-        const std::vector<double> &sigmas,
-        int frameNum,
-        double fs
-        )
+    void GmmFrameEvaluator::evaluate(const std::vector<StochasticCommandConstraint> &sccs,
+                                    std::vector<GmmFrameLogDensity> &onsets,
+                                    std::vector<GmmFrameLogDensity> &offsets)
     {
+        onsets.resize(sccs.size());
+        offsets.resize(sccs.size());
+        for (unsigned iAcc=0; iAcc<sccs.size(); iAcc++)
+        {
+            evaluate(sccs[iAcc].onBasetime, sccs[iAcc].onWeights,
+                    sccs[iAcc].onMeans, sccs[iAcc].onSigmas, onsets[iAcc]);
+            evaluate(sccs[iAcc].offBasetime, sccs[iAcc].offWeights,
+                    sccs[iAcc].offMeans, sccs[iAcc].offSigmas, offsets[iAcc]);
+        }
+    }
+
+
+    void GmmFrameEvaluator::evaluate(double basetime,
+                                    const std::vector<double> &weights,
+                                    const std::vector<double> &means,
+                                    const std::vector<double> &sigmas,
+                                    GmmFrameLogDensity &result)
+    {
+        unsigned componentNum = weights.size();
+        result.frameBegin = result.frameEnd = 0;
+        result.maxLogprob = result.floorLogprob = -std::numeric_limits<double>::infinity();
+        result.logprob.clear();
+
+        logCoefs.resize(componentNum);
+        for (unsigned i=0; i<componentNum; i++)
+        {
+            logCoefs[i] = log(weights[i] / sqrt(2.0 * M_PI) / sigmas[i]);
+        }
+
+        // Lower bound of the max. density: the density at the frames nearest to the means.
+        double maxLowerBound = -std::numeric_limits<double>::infinity();
+        for (unsigned i=0; i<componentNum; i++)
+        {
+            if (!(weights[i] > 0.0)) continue;
+            double nearest = std::round((basetime + means[i]) * fs);
+            unsigned frame = (unsigned)std::min(std::max(nearest, 0.0), (double)frameNum - 1.0);
+            maxLowerBound = std::max(maxLowerBound, _logDensityAt(frame, basetime, means, sigmas));
+        }
+        if (frameNum == 0 || maxLowerBound == -std::numeric_limits<double>::infinity()) return;
+
+        // A frame above the threshold has at least one component above
+        // (threshold - log(componentNum)), so the union of the component windows covers it.
+        double componentFloor = maxLowerBound - pruneThreshold - log((double)componentNum);
+        double windowBegin = frameNum;
+        double windowEnd = -1.0;
+        for (unsigned i=0; i<componentNum; i++)
+        {
+            if (!(weights[i] > 0.0) || logCoefs[i] < componentFloor) continue;
+            double halfWidth = sigmas[i] * std::sqrt(2.0 * (logCoefs[i] - componentFloor));
+            windowBegin = std::min(windowBegin, std::floor((basetime + means[i] - halfWidth) * fs));
+            windowEnd = std::max(windowEnd, std::ceil((basetime + means[i] + halfWidth) * fs));
+        }
+        windowBegin = std::max(windowBegin, 0.0);
+        windowEnd = std::min(windowEnd, (double)frameNum - 1.0);
+        if (windowEnd < windowBegin) return;
+
+        unsigned frameBegin = (unsigned)windowBegin;
+        unsigned frameEnd = (unsigned)windowEnd + 1;
+        _logDensityWindow(frameBegin, frameEnd, basetime, means, sigmas, sums);
+
+        double maxLogprob = *std::max_element(sums.begin(), sums.end());
+        double floorLogprob = maxLogprob - pruneThreshold;
+
+        // Shrink the window to the frames above the threshold.
+        unsigned first = 0;
+        unsigned last = frameEnd - frameBegin - 1;
+        while (sums[first] < floorLogprob) ++first;
+        while (sums[last] < floorLogprob) --last;
+
+        result.frameBegin = frameBegin + first;
+        result.frameEnd = frameBegin + last + 1;
+        result.maxLogprob = maxLogprob;
+        result.floorLogprob = floorLogprob;
+        result.logprob.assign(sums.begin() + first, sums.begin() + last + 1);
+    }
+
+
+    double GmmFrameEvaluator::_logDensityAt(unsigned frame, double basetime,
+                                    const std::vector<double> &means, const std::vector<double> &sigmas)
+    {
+        _logDensityWindow(frame, frame + 1, basetime, means, sigmas, sums);
+        return sums[0];
+    }
+
 
-        std::vector<double> result_logprob(frameNum);
+    void GmmFrameEvaluator::_logDensityWindow(unsigned frameBegin, unsigned frameEnd, double basetime,
+                                    const std::vector<double> &means, const std::vector<double> &sigmas,
+                                    std::vector<double> &logprob)
+    {
+        // log-sum-exp over the components, component-major.
+        // Components of weight 0 (logCoefs -inf) are skipped, also for the maxima.
+        unsigned componentNum = logCoefs.size();
+        unsigned window = frameEnd - frameBegin;
+        powers.resize((size_t)componentNum * window);
+        maxPowers.assign(window, -std::numeric_limits<double>::infinity());
+        logprob.assign(window, 0.0);
 
-        for (unsigned iFr=0; iFr<frameNum; iFr++)
+        for (unsigned i=0; i<componentNum; i++)
         {
-            double t_diff = (double)iFr / fs - basetime;
-            std::vector<double> powers(weights.size());
-            for (unsigned i=0; i<powers.size(); i++)
+            if (!(logCoefs[i] > -std::numeric_limits<double>::infinity())) continue;
+            double *power = &powers[(size_t)i * window];
+            double offset = basetime + means[i];
+            double invsigma2 = 1.0 / sigmas[i] / sigmas[i];
+            for (unsigned j=0; j<window; j++)
             {
-                powers[i] = - 0.5 * (t_diff - means[i]) * (t_diff - means[i]) / sigmas[i] / sigmas[i];
-                // std::cout << powers[i] << std::endl;
+                double t_diff = (double)(frameBegin + j) / fs - offset;
+                power[j] = - 0.5 * t_diff * t_diff * invsigma2;
+                maxPowers[j] = std::max(maxPowers[j], power[j]);
             }
-            auto argmaxpower = std::max_element(powers.begin(), powers.end());
-
-            double prob_tmp = 0.0;
-            for (unsigned i=0; i<powers.size(); i++)
+        }
+        for (unsigned i=0; i<componentNum; i++)
+        {
+            if (!(logCoefs[i] > -std::numeric_limits<double>::infinity())) continue;
+            const double *power = &powers[(size_t)i * window];
+            double coef = exp(logCoefs[i]);
+            for (unsigned j=0; j<window; j++)
             {
-                prob_tmp += weights[i] / sqrt(2.0 * M_PI) / sigmas[i] * exp(powers[i] - *argmaxpower);
+                logprob[j] += coef * exp(power[j] - maxPowers[j]);
             }
-            result_logprob[iFr] = log(prob_tmp) + *argmaxpower;
         }
-        return result_logprob;
+        for (unsigned j=0; j<window; j++)
+        {
+            logprob[j] = log(logprob[j]) + maxPowers[j];
+        }
     }
 
+
     void EmEstimationConstrained::imposeStochasticConst(const std::vector<StochasticCommandConstraint> &sccs)
     {
+        STFMEST_TRACE_SCOPE("imposeStochasticConst");
+        if (preparationStatus != NO_ERROR) return; // reported by validate()
+        Timer t;
         // std::cout << "Start stochastic const." << std::endl;
-        flagConst = true;
-        constraintProbLog = std::vector<std::vector<double> >(frameNum, std::vector<double>(stateNum, 0.0));
+        _clearConstraintProbLog();
         // return;
         // std::cout << hmm.getStatus() << std::endl;
 
+        std::vector<std::pair<unsigned, unsigned> > removedCells; // (frame, small state)
+        std::vector<GmmFrameLogDensity> onsetDists, offsetDists;
+        GmmFrameEvaluator gmm(frameNum, input.fs, pruneThreshold);
+        gmm.evaluate(sccs, onsetDists, offsetDists);
+        unsigned accentBranchNum = (unsigned)config.accentBranchNum;
+
         // std::cout << "sccs length:" << sccs.size() << std::endl;
         for (unsigned iAcc=0; iAcc<sccs.size(); iAcc++)
         {
-            std::vector<double> onsetDist = _tmp_calcGmmLogsumexp (
-                sccs[iAcc].onBasetime, sccs[iAcc].onWeights,
-                sccs[iAcc].onMeans, sccs[iAcc].onSigmas,
-                frameNum, input.fs
-                );
-            auto onsetDistMaxIter = std::max(onsetDist.begin(), onsetDist.end());
-
-            std::vector<double> offsetDist = _tmp_calcGmmLogsumexp (
-                sccs[iAcc].offBasetime, sccs[iAcc].offWeights,
-                sccs[iAcc].offMeans, sccs[iAcc].offSigmas,
-                frameNum, input.fs
-                );
-            auto offsetDistMaxIter = std::max(offsetDist.begin(), offsetDist.end());
+            const GmmFrameLogDensity &onsetDist = onsetDists[iAcc];
+            const GmmFrameLogDensity &offsetDist = offsetDists[iAcc];
             
-            for (unsigned iBranch=0; iBranch<config.accentBranchNum; iBranch++)
+            // Small states just before the accent onset, shared by the branches.
+            std::vector<unsigned> prevSsIds;
+            for (unsigned iBranch=0; iBranch<accentBranchNum; iBranch++)
+            {
+                unsigned iSsBegin = bigStateHead[accentNumToBigState[iAcc*accentBranchNum+iBranch]];
+                prevSsIds.insert(prevSsIds.end(), smallStates[iSsBegin].backwardConnects.begin(),
+                                smallStates[iSsBegin].backwardConnects.end());
+            }
+            std::sort(prevSsIds.begin(), prevSsIds.end());
+            prevSsIds.erase(std::unique(prevSsIds.begin(), prevSsIds.end()), prevSsIds.end());
+
+            for (unsigned prevSsId : prevSsIds)
             {
-                unsigned iSsBegin = stateNum;
-                unsigned iSsEnd = stateNum;
-                for (unsigned iSs=0; iSs<stateNum; iSs++)
+                // constraintProbLog[iFr-1][prevSsId] = onsetDist[iFr]
+                if (onsetDist.frameBegin > 0)
                 {
-                    if (iSsBegin == stateNum && smallStates[iSs].bigstateId == accentNumToBigState[iAcc*config.accentBranchNum+iBranch]) iSsBegin = iSs;
-                    if (iSsBegin < stateNum && iSsEnd == stateNum && smallStates[iSs].bigstateId != accentNumToBigState[iAcc*config.accentBranchNum+iBranch]) iSsEnd = iSs-1;
+                    _setConstraintProbLog(prevSsId, onsetDist.frameBegin - 1, onsetDist.logprob);
                 }
-                // std::cout << iBranch << " " << iSsBegin << " " << iSsEnd << std::endl;
-
-                for (unsigned prevSsId : smallStates[iSsBegin].backwardConnects)
+                else if (onsetDist.frameEnd > 1)
+                {
+                    _setConstraintProbLog(prevSsId, 0, std::vector<double>(onsetDist.logprob.begin() + 1, onsetDist.logprob.end()));
+                }
+                _restrictStateFrames(prevSsId, std::max(onsetDist.frameBegin, 1u) - 1, std::max(onsetDist.frameEnd, 1u) - 1);
+                for (unsigned iFr=std::max(onsetDist.frameBegin, 1u); iFr<onsetDist.frameEnd; iFr++)
                 {
-                    // std::cout << iSsBegin << " " << prevSsId << std::endl;
-                    for (unsigned iFr=1; iFr<frameNum; iFr++)
-                    {
-                        constraintProbLog[iFr-1][prevSsId] = onsetDist[iFr];
-                        if (onsetDist[iFr] < *onsetDistMaxIter - 4.6 )
-                        {
-                            isReachable[iFr-1][prevSsId] = false;
-                            // std::cout << iFr << " " << prevSsId << std::endl;
-                        }
-                    }
+                    if (onsetDist.isPruned(iFr)) removedCells.push_back(std::make_pair(iFr-1, prevSsId));
                 }
-                for (unsigned iFr=0; iFr<frameNum-1; iFr++)
+            }
+
+            for (unsigned iBranch=0; iBranch<accentBranchNum; iBranch++)
+            {
+                unsigned iBig = accentNumToBigState[iAcc*accentBranchNum+iBranch];
+                unsigned iSsEnd = bigStateHead[iBig] + bigStateLen[iBig] - 1;
+
+                // constraintProbLog[iFr+1][iSsEnd] = offsetDist[iFr]
+                _setConstraintProbLog(iSsEnd, offsetDist.frameBegin + 1, offsetDist.logprob);
+                _restrictStateFrames(iSsEnd, offsetDist.frameBegin + 1, offsetDist.frameEnd + 1);
+                for (unsigned iFr=offsetDist.frameBegin; iFr<offsetDist.frameEnd && iFr<frameNum-1; iFr++)
                 {
-                    constraintProbLog[iFr+1][iSsEnd] = offsetDist[iFr];
-                    if (offsetDist[iFr] < *offsetDistMaxIter-4.6) isReachable[iFr+1][iSsEnd] = false;
+                    if (offsetDist.isPruned(iFr)) removedCells.push_back(std::make_pair(iFr+1, iSsEnd));
                 }
             }
         }
-        _updateReachableStateInfo();
+        _updateReachableStateInfoIncremental(removedCells);
+        profile.constraints += t.stop();
+        _updateMemoryPeak();
+    }
+
+
+    std::vector<std::vector<double> > EmEstimationConstrained::getConstraintProb()
+    {
+        std::vector<std::vector<double> > constraintProbLog(frameNum, std::vector<double>(stateNum, 0.0));
+        for (unsigned iSs=0; iSs<stateNum; iSs++)
+        {
+            if (constraintIdOfState[iSs] < 0) continue;
+            const StateConstraint &sc = stateConstraints[constraintIdOfState[iSs]];
+            for (unsigned i=0; i<sc.logprob.size() && sc.frameBegin + i < frameNum; i++)
+            {
+                constraintProbLog[sc.frameBegin + i][iSs] = sc.logprob[i];
+            }
+        }
+        return constraintProbLog;
     }
 }
@@ -50,12 +50,63 @@ namespace stfmest
     }
 
 
+    // Log density of a GMM on the frames [frameBegin, frameEnd).
+    // The frames outside are below (maxLogprob - pruning threshold).
+    struct GmmFrameLogDensity
+    {
+        unsigned frameBegin = 0;
+        unsigned frameEnd = 0;
+        double maxLogprob;
+        double floorLogprob; // maxLogprob - pruning threshold
+        std::vector<double> logprob; // logprob[i] is for frame (frameBegin + i)
+
+        inline bool isPruned(unsigned frame) const
+        {
+            return frame < frameBegin || frame >= frameEnd
+                || logprob[frame - frameBegin] < floorLogprob;
+        }
+    };
+
+
+    // Evaluates the onset/offset GMMs of constraints on the frame grid
+    // only in the window where they are above the pruning threshold.
+    // The scratch buffers are kept between calls.
+    class GmmFrameEvaluator
+    {
+    public:
+        GmmFrameEvaluator(unsigned frameNum, double fs, double pruneThreshold):
+            frameNum(frameNum), fs(fs), pruneThreshold(pruneThreshold) {}
+
+        void evaluate(const std::vector<StochasticCommandConstraint> &sccs,
+                    std::vector<GmmFrameLogDensity> &onsets,
+                    std::vector<GmmFrameLogDensity> &offsets);
+        void evaluate(double basetime,
+                    const std::vector<double> &weights,
+                    const std::vector<double> &means,
+                    const std::vector<double> &sigmas,
+                    GmmFrameLogDensity &result);
+    private:
+        unsigned frameNum;
+        double fs;
+        double pruneThreshold;
+        std::vector<double> logCoefs; // log(weight / sqrt(2 pi) / sigma) of each component
+        std::vector<double> powers; // powers[i * window + j]: exponent of i-th component at j-th frame
+        std::vector<double> maxPowers;
+        std::vector<double> sums;
+
+        double _logDensityAt(unsigned frame, double basetime, const std::vector<double> &means, const std::vector<double> &sigmas);
+        void _logDensityWindow(unsigned frameBegin, unsigned frameEnd, double basetime,
+                    const std::vector<double> &means, const std::vector<double> &sigmas,
+                    std::vector<double> &logprob);
+    };
+
+
     class EmEstimationConstrained : public EmEstimation
     {
         using EmEstimation::EmEstimation;
-        bool flagConst = false;
+        static constexpr double pruneThreshold = 4.6; // frames below (max log density - 4.6) are unreachable
     public:
         void imposeStochasticConst(const std::vector<StochasticCommandConstraint> &sccs);
-        inline std::vector<std::vector<double> > getConstraintProb() { return constraintProbLog; }
+        std::vector<std::vector<double> > getConstraintProb(); // dense frameNum x stateNum matrix
     };
 }
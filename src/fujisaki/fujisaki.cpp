@@ -2,73 +2,69 @@
 #include <iostream>
 #include <cmath>
 #include "fujisaki.hpp"
+#include "fujisaki_synthesizer.hpp"
+#include "error_codes.hpp"
 
 
 namespace stfmest
 {
-    std::vector<double> criticalfilter(const FujisakiCommand &command, double fs, int frameNum)
+    std::vector<double> criticalfilter(const FujisakiCommand &command, double fs, int frameNum, int *status)
     {
         std::vector<double> output(frameNum, 0.0);
-        
-        if (command.offset < command.onset)
-        {
-            std::cerr << "Command onset/offset time invalid: " << command.onset << " " << command.offset << std::endl;
-            exit(1);
-        }
+        int status_ = FujisakiSynthesizer().add(command, fs, output);
+        if (status != nullptr) *status = status_;
+        return output;
+    }
 
-        if (command.omega < 1e-9)
-        {
-            std::cerr << "Command time constant too small: " << command.omega << std::endl;
-            exit(1);
-        }
 
-        if ((command.offset - command.onset) * command.omega < 0.01)
-        {
-            // For impluse-like command
-            for (unsigned i=0; i<output.size(); i++)
-            {
-                double time_ = (double)i / fs;
-                output[i] = impulse_response(command.omega, time_ - command.onset)
-                            * command.integratedAmplitude;
-            }
-        }
-        else
-        {
-            // For rectangular-like command
-            double amplitude = command.integratedAmplitude / (command.offset - command.onset);
+    std::vector<double> criticalfilter(const std::vector<FujisakiCommand> &commands,
+                                    double mub, double fs, int frameNum, int *status)
+    {
+        std::vector<double> sum(frameNum);
+        int status_ = FujisakiSynthesizer().synthesize(commands, mub, fs, sum);
+        if (status != nullptr) *status = status_;
+        return sum;
+    }
 
-            for (unsigned i=0; i<output.size(); i++)
-            {
-                double time_ = (double)i / fs;
-                output[i] = (step_response(command.omega, time_ - command.onset)
-                        - step_response(command.omega, time_ - command.offset))
-                        * amplitude;
-            }
+    void addFilteredExcitation(const std::vector<double> &u, double omega, double fs, std::vector<double> &y)
+    {
+        double r = std::exp(-omega / fs);
+        double cr = omega * omega / (fs * fs) * r;
+        double y1 = 0.0, y2 = 0.0; // filter output at k-1, k-2
+        for (unsigned k=1; k<y.size(); k++)
+        {
+            double y0 = 2.0 * r * y1 - r * r * y2 + cr * u[k-1];
+            y[k] += y0;
+            y2 = y1;
+            y1 = y0;
         }
-
-        return output;
     }
 
 
-    std::vector<double> criticalfilter(const std::vector<FujisakiCommand> &commands,
-                                    double mub, double fs, int frameNum)
+    void addFilteredExcitationTransposed(const std::vector<double> &u, double omega, double fs, std::vector<double> &y)
     {
-        std::vector<double> sum(frameNum, mub);
-        for (auto comm : commands)
+        double r = std::exp(-omega / fs);
+        double cr = omega * omega / (fs * fs) * r;
+        double y1 = 0.0, y2 = 0.0; // filter output at l+1, l+2
+        for (unsigned l=y.size(); l-->1; )
         {
-            std::vector<double> tmp = criticalfilter(comm, fs, frameNum);
-            std::transform(sum.begin(), sum.end(), tmp.begin(), sum.begin(), std::plus<double>());
+            double y0 = 2.0 * r * y1 - r * r * y2 + cr * u[l];
+            y[l-1] += y0;
+            y2 = y1;
+            y1 = y0;
         }
-        return sum;
     }
 
+
     double rmse(const std::vector<double> &lf0a, const std::vector<double> &lf0b,
-                const std::vector<double> &vuv, double vuvThres)
+                const std::vector<double> &vuv, double vuvThres, int *status)
     {
+        if (status != nullptr) *status = NO_ERROR;
         if (lf0a.size() != lf0b.size() || lf0a.size() != vuv.size())
         {
             std::cerr << "Input length not matched: " << lf0a.size() << " " << lf0b.size() << " " << vuv.size() << std::endl;
-            exit(1);
+            if (status != nullptr) *status = INPUT_VECTOR_SIZE_MISMATCH;
+            return 1E20;
         }
         double squaredError = 0.0;
         int voicedNum = 0;  
@@ -75,9 +75,24 @@ namespace stfmest
     }
 
 
-    std::vector<double> criticalfilter(const FujisakiCommand &command, double fs, int frameNum);
-    std::vector<double> criticalfilter(const std::vector<FujisakiCommand> &commands, double mub, double fs, int frameNum);
+    // Invalid commands are skipped, with VALUE_INVALID in *status (see error_codes.hpp) if status is given.
+    std::vector<double> criticalfilter(const FujisakiCommand &command, double fs, int frameNum, int *status = nullptr);
+    std::vector<double> criticalfilter(const std::vector<FujisakiCommand> &commands, double mub, double fs, int frameNum,
+                                       int *status = nullptr);
 
 
-    double rmse(const std::vector<double> &lf0a, const std::vector<double> &lf0b, const std::vector<double> &vuv, double vuvThres);
+    // Filter output of an excitation sampled at fs (e.g. mup, mua), added to y:
+    //   y[k] += sum_{l<=k} impulse_response(omega, (k-l)/fs) / fs * u[l]   (k < y.size())
+    // by the recursion y[k] = 2r y[k-1] - r^2 y[k-2] + c r u[k-1]
+    // with r = exp(-omega/fs) and c = omega^2/fs^2, in O(y.size()).
+    void addFilteredExcitation(const std::vector<double> &u, double omega, double fs, std::vector<double> &y);
+
+    // Transposed one, running backward in time:
+    //   y[l] += sum_{k>=l} impulse_response(omega, (k-l)/fs) / fs * u[k]   (l, k < y.size())
+    void addFilteredExcitationTransposed(const std::vector<double> &u, double omega, double fs, std::vector<double> &y);
+
+
+    // 1E20 if no frame is voiced, or if the lengths differ (with INPUT_VECTOR_SIZE_MISMATCH in *status).
+    double rmse(const std::vector<double> &lf0a, const std::vector<double> &lf0b, const std::vector<double> &vuv, double vuvThres,
+                int *status = nullptr);
 }
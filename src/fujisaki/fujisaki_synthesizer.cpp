@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "fujisaki_synthesizer.hpp"
+#include "error_codes.hpp"
+
+
+namespace stfmest
+{
+    // First frame after time t0 (0 if t0 < 0)
+    static unsigned _firstFrameAfter(double t0, double fs)
+    {
+        if (t0 < 0.0) return 0;
+        unsigned frame = (unsigned)std::min(std::floor(t0 * fs) + 1.0, 4294967295.0);
+        // Correct the rounding error of t0 * fs
+        while (frame > 0 && (double)(frame - 1) / fs > t0) --frame;
+        while (frame < 4294967295u && (double)frame / fs <= t0) ++frame;
+        return frame;
+    }
+
+
+    const FujisakiSynthesizer::KernelTable &FujisakiSynthesizer::_getTable(double omega, double fs, unsigned length)
+    {
+        KernelTable *table = nullptr;
+        for (auto &t : tables)
+        {
+            if (t.omega == omega && t.fs == fs) table = &t;
+        }
+        if (table == nullptr)
+        {
+            tables.push_back(KernelTable());
+            table = &tables.back();
+            table->omega = omega;
+            table->fs = fs;
+
+            // (1 + x) exp(-x) decreases monotonically for x > 0.
+            double x = 1.0;
+            while ((1.0 + x) * std::exp(-x) >= tolerance) x *= 1.1;
+            double horizon = std::ceil(x / omega * fs) + 1.0;
+            table->horizon = (unsigned)std::min(horizon, 4294967295.0);
+        }
+
+        // Tables are sampled only up to the longest signal so far.
+        length = std::min(length, table->horizon);
+        for (unsigned k=table->decay.size(); k<length; k++)
+        {
+            double tsec = (double)k / fs;
+            table->decay.push_back(std::exp(-omega * tsec));
+            table->timeDecay.push_back(tsec * table->decay.back());
+        }
+        return *table;
+    }
+
+
+    // Frames before the onset are 0, so the command is added from the first frame after onset.
+    // With delta = (the frame time) - onset, the response at k frames later is given by
+    // exp(-omega (delta + k / fs)) = exp(-omega delta) decay[k].
+    void FujisakiSynthesizer::_addImpulse(const FujisakiCommand &command, double fs, std::vector<double> &output)
+    {
+        unsigned frameNum = output.size();
+        unsigned frameBegin = _firstFrameAfter(command.onset, fs);
+        if (frameBegin >= frameNum) return;
+
+        const KernelTable &table = _getTable(command.omega, fs, frameNum - frameBegin);
+        double omega = command.omega;
+        double delta = (double)frameBegin / fs - command.onset;
+        double coef = omega * omega * std::exp(-omega * delta) * command.integratedAmplitude;
+
+        unsigned frameEnd = frameBegin + std::min((unsigned)table.decay.size(), frameNum - frameBegin);
+        for (unsigned i=frameBegin, k=0; i<frameEnd; i++, k++)
+        {
+            output[i] += coef * (delta * table.decay[k] + table.timeDecay[k]);
+        }
+    }
+
+
+    void FujisakiSynthesizer::_addRectangle(const FujisakiCommand &command, double fs, std::vector<double> &output)
+    {
+        unsigned frameNum = output.size();
+        unsigned onsetBegin = _firstFrameAfter(command.onset, fs);
+        if (onsetBegin >= frameNum) return;
+        unsigned offsetBegin = std::min(_firstFrameAfter(command.offset, fs), frameNum);
+
+        const KernelTable &table = _getTable(command.omega, fs, frameNum - onsetBegin);
+        unsigned tableLen = table.decay.size();
+        double omega = command.omega;
+        double amplitude = command.integratedAmplitude / (command.offset - command.onset);
+
+        // step_response(omega, delta + k / fs) == 1 - coef0 decay[k] - coef1 timeDecay[k]
+        double onsetDelta = (double)onsetBegin / fs - command.onset;
+        double onsetExp = std::exp(-omega * onsetDelta);
+        double onsetCoef0 = onsetExp * (1.0 + omega * onsetDelta);
+        double onsetCoef1 = onsetExp * omega;
+        double offsetDelta = (double)offsetBegin / fs - command.offset;
+        double offsetExp = std::exp(-omega * offsetDelta);
+        double offsetCoef0 = offsetExp * (1.0 + omega * offsetDelta);
+        double offsetCoef1 = offsetExp * omega;
+
+        // Rising part: only the onset step
+        unsigned i = onsetBegin;
+        for (unsigned k=0; i<offsetBegin; i++, k++)
+        {
+            double stepOn = k < tableLen ? 1.0 - onsetCoef0 * table.decay[k] - onsetCoef1 * table.timeDecay[k] : 1.0;
+            output[i] += stepOn * amplitude;
+        }
+
+        // Falling part: until both steps reach 1
+        unsigned frameEnd = offsetBegin + std::min(tableLen, frameNum - offsetBegin);
+        for (unsigned k=offsetBegin-onsetBegin, l=0; i<frameEnd; i++, k++, l++)
+        {
+            double stepOn = k < tableLen ? 1.0 - onsetCoef0 * table.decay[k] - onsetCoef1 * table.timeDecay[k] : 1.0;
+            double stepOff = 1.0 - offsetCoef0 * table.decay[l] - offsetCoef1 * table.timeDecay[l];
+            output[i] += (stepOn - stepOff) * amplitude;
+        }
+    }
+
+
+    int FujisakiSynthesizer::add(const FujisakiCommand &command, double fs, std::vector<double> &output)
+    {
+        if (!(command.offset >= command.onset))
+        {
+            std::cerr << "Command onset/offset time invalid: " << command.onset << " " << command.offset << std::endl;
+            return VALUE_INVALID;
+        }
+
+        if (!(fs > 0.0))
+        {
+            std::cerr << "Sampling frequency invalid: " << fs << std::endl;
+            return VALUE_INVALID;
+        }
+
+        if (!(command.omega >= 1e-9))
+        {
+            std::cerr << "Command time constant too small: " << command.omega << std::endl;
+            return VALUE_INVALID;
+        }
+
+        if ((command.offset - command.onset) * command.omega < 0.01)
+        {
+            // For impluse-like command
+            _addImpulse(command, fs, output);
+        }
+        else
+        {
+            // For rectangular-like command
+            _addRectangle(command, fs, output);
+        }
+        return NO_ERROR;
+    }
+
+
+    int FujisakiSynthesizer::synthesize(const std::vector<FujisakiCommand> &commands, double mub, double fs, std::vector<double> &output)
+    {
+        int status = NO_ERROR;
+        std::fill(output.begin(), output.end(), mub);
+        for (const auto &comm : commands)
+        {
+            int commandStatus = add(comm, fs, output);
+            if (status == NO_ERROR) status = commandStatus;
+        }
+        return status;
+    }
+}
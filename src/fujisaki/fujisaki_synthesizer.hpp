@@ -0,0 +1,46 @@
+// Synthesis of F0 contours from Fujisaki commands
+//
+// The filter responses are looked up from tables sampled per (omega, fs)
+// and added only to the frames where they are not negligible.
+
+#pragma once
+
+#include <vector>
+#include "fujisaki.hpp"
+
+
+namespace stfmest
+{
+    class FujisakiSynthesizer
+    {
+    public:
+        // Responses are cut where (1 + omega t) exp(-omega t) < tolerance.
+        explicit FujisakiSynthesizer(double tolerance = 1e-12): tolerance(tolerance) {}
+
+        // Add the filter output of one command to output (output.size() == frame No.)
+        // Returns VALUE_INVALID (see error_codes.hpp) without adding an invalid command.
+        int add(const FujisakiCommand &command, double fs, std::vector<double> &output);
+
+        // output = mub + sum of the filter outputs (output.size() == frame No.)
+        // Returns VALUE_INVALID if any command is invalid; the others are added.
+        int synthesize(const std::vector<FujisakiCommand> &commands, double mub, double fs, std::vector<double> &output);
+
+    private:
+        // Sampled responses of the filter with omega at fs
+        struct KernelTable
+        {
+            double omega;
+            double fs;
+            unsigned horizon; // responses are negligible from the horizon-th sample
+            std::vector<double> decay; // decay[k] = exp(-omega k / fs)
+            std::vector<double> timeDecay; // timeDecay[k] = k / fs * exp(-omega k / fs)
+        };
+
+        double tolerance;
+        std::vector<KernelTable> tables;
+
+        const KernelTable &_getTable(double omega, double fs, unsigned length);
+        void _addImpulse(const FujisakiCommand &command, double fs, std::vector<double> &output);
+        void _addRectangle(const FujisakiCommand &command, double fs, std::vector<double> &output);
+    };
+}
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include "batch_synthesis.hpp"
+#include "error_codes.hpp"
+#include "estimation_result.hpp"
+
+
+namespace stfmest
+{
+    SynthesisJob jsonToSynthesisJob(const nlohmann::json &j, const SynthesisDefaults &defaults)
+    {
+        SynthesisJob job;
+        job.fs = defaults.fs;
+        job.mub = defaults.mub;
+
+        if (j.is_array())
+        {
+            job.commands = j.get<std::vector<FujisakiCommand> >();
+        }
+        else
+        {
+            job.commands = j.at("commands").get<std::vector<FujisakiCommand> >();
+            if (j.count("fs")) job.fs = j.at("fs").get<double>();
+            if (j.count("mub")) job.mub = j.at("mub").get<double>();
+        }
+
+        if (!j.is_array() && j.count("frameNum"))
+        {
+            job.frameNum = j.at("frameNum").get<unsigned>();
+        }
+        else if (!j.is_array() && j.count("regeneratedlf0"))
+        {
+            job.frameNum = j.at("regeneratedlf0").size();
+        }
+        else
+        {
+            double lastOffset = 0.0;
+            for (const auto &comm : job.commands) lastOffset = std::max(lastOffset, comm.offset);
+            job.frameNum = (unsigned)std::ceil((lastOffset + defaults.tailSec) * job.fs);
+        }
+        return job;
+    }
+
+
+    BatchSynthesizer::BatchSynthesizer(unsigned threadNum, const SynthesisDefaults &defaults): defaults(defaults)
+    {
+        synthesizers.resize(std::max(threadNum, 1u));
+        workerContours.resize(synthesizers.size());
+    }
+
+
+    template <class Func>
+    void BatchSynthesizer::_parallelFor(unsigned n, const Func &func)
+    {
+        std::atomic<unsigned> next(0);
+        auto work = [&](unsigned worker)
+        {
+            for (unsigned i = next++; i < n; i = next++) func(worker, i);
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned w=1; w<synthesizers.size() && w<n; w++) threads.push_back(std::thread(work, w));
+        work(0);
+        for (auto &t : threads) t.join();
+    }
+
+
+    void BatchSynthesizer::synthesize(const std::vector<SynthesisJob> &jobs, std::vector<std::vector<double> > &contours)
+    {
+        contours.resize(jobs.size());
+        std::vector<char> isFailed(jobs.size(), 0);
+        _parallelFor(jobs.size(), [&](unsigned worker, unsigned i)
+        {
+            contours[i].resize(jobs[i].frameNum);
+            int status = synthesizers[worker].synthesize(jobs[i].commands, jobs[i].mub, jobs[i].fs, contours[i]);
+            isFailed[i] = status != NO_ERROR;
+        });
+        for (unsigned i=0; i<jobs.size(); i++)
+        {
+            frameNum += jobs[i].frameNum;
+            errorNum += isFailed[i];
+        }
+    }
+
+
+    void BatchSynthesizer::synthesize(const std::vector<std::string> &commandSets, std::vector<std::string> &contourLines)
+    {
+        contourLines.resize(commandSets.size());
+        std::vector<unsigned> frameNums(commandSets.size(), 0);
+        std::vector<char> isFailed(commandSets.size(), 0);
+        _parallelFor(commandSets.size(), [&](unsigned worker, unsigned i)
+        {
+            try
+            {
+                nlohmann::json j = nlohmann::json::parse(commandSets[i]);
+                if (isErrorResult(j))
+                {
+                    contourLines[i] = j.dump(); // a failed item of the estimation is passed through
+                    isFailed[i] = 1;
+                    return;
+                }
+                SynthesisJob job = jsonToSynthesisJob(j, defaults);
+                if (!(job.fs > 0.0))
+                {
+                    contourLines[i] = nlohmann::json{{"error", "frame rate not given"}, {"status", VALUE_INVALID}}.dump();
+                    isFailed[i] = 1;
+                    return;
+                }
+                std::vector<double> &contour = workerContours[worker];
+                contour.resize(job.frameNum);
+                int status = synthesizers[worker].synthesize(job.commands, job.mub, job.fs, contour);
+                if (status != NO_ERROR)
+                {
+                    contourLines[i] = nlohmann::json{{"error", "invalid command"}, {"status", status}}.dump();
+                    isFailed[i] = 1;
+                    return;
+                }
+                contourLines[i] = nlohmann::json{{"fs", job.fs}, {"mub", job.mub}, {"lf0", contour}}.dump();
+                frameNums[i] = job.frameNum;
+            }
+            catch (const std::exception &e)
+            {
+                contourLines[i] = nlohmann::json{{"error", e.what()}}.dump();
+                isFailed[i] = 1;
+            }
+        });
+        for (unsigned i=0; i<commandSets.size(); i++)
+        {
+            frameNum += frameNums[i];
+            errorNum += isFailed[i];
+        }
+    }
+}
@@ -0,0 +1,65 @@
+// Synthesis of many F0 contours from stored command sets
+//
+// A command set is given in JSON by an array of commands, or by an object
+// with "commands" and the optional "fs", "mub" and "frameNum"
+// (e.g. an EstimationResult, whose "regeneratedlf0" gives the frame No.).
+
+#pragma once
+#include <string>
+#include <vector>
+#include "json.hpp"
+#include "fujisaki.hpp"
+#include "fujisaki_synthesizer.hpp"
+
+
+namespace stfmest
+{
+    struct SynthesisJob
+    {
+        double fs;
+        double mub;
+        unsigned frameNum;
+        std::vector<FujisakiCommand> commands;
+    };
+
+
+    // Used for the fields not given in a command set
+    struct SynthesisDefaults
+    {
+        double fs = 0.0; // 0: none, a command set without "fs" fails
+        double mub = 0.0;
+        double tailSec = 1.0; // frame No. = (last offset + tailSec) * fs if not given
+    };
+
+
+    SynthesisJob jsonToSynthesisJob(const nlohmann::json &j, const SynthesisDefaults &defaults);
+
+
+    // Synthesizes contours in parallel. The kernel tables of each worker are kept between calls.
+    class BatchSynthesizer
+    {
+    public:
+        BatchSynthesizer(unsigned threadNum, const SynthesisDefaults &defaults);
+
+        // A job with an invalid command is counted in getErrorNum(); the other commands are synthesized.
+        void synthesize(const std::vector<SynthesisJob> &jobs, std::vector<std::vector<double> > &contours);
+
+        // From command sets in JSON text to contours in JSON text ({"fs", "mub", "lf0"}).
+        // A command set which cannot be read gives {"error": message}, and one with an invalid command
+        // or no frame rate gives {"error": message, "status": error code}; a failed item of the estimation
+        // ({"error", "status"}) is output as it is. All of them are counted in getErrorNum().
+        void synthesize(const std::vector<std::string> &commandSets, std::vector<std::string> &contourLines);
+
+        inline unsigned long long getFrameNum() const { return frameNum; } // No. of frames synthesized so far
+        inline unsigned long long getErrorNum() const { return errorNum; }
+
+    private:
+        SynthesisDefaults defaults;
+        std::vector<FujisakiSynthesizer> synthesizers; // one per worker
+        std::vector<std::vector<double> > workerContours;
+        unsigned long long frameNum = 0;
+        unsigned long long errorNum = 0;
+
+        template <class Func> void _parallelFor(unsigned n, const Func &func); // func(worker, i)
+    };
+}
@@ -0,0 +1,99 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "cmdline.h"
+
+#include "iofile.hpp"
+#include "timer.hpp"
+#include "batch_synthesis.hpp"
+
+
+int main(int argc, char *argv[])
+{
+    cmdline::parser args;
+
+    args.add<std::string>("in", 'i', "command set file name (.json or .jsonl)", false, "output.json");
+    args.add<std::string>("out", 'o', "output file name (JSON lines)", false, "synth.jsonl");
+    args.add<double>("fs", 'f', "frame rate if not given in a command set (0: required in each set)", false, 0.0);
+    args.add<double>("mub", 'b', "baseline log F0 if not given in a command set", false, 0.0);
+    args.add<double>("tail", 'l', "length after the last command [sec] if frameNum not given", false, 1.0);
+    args.add<unsigned>("jobs", 'j', "No. of threads (0: hardware concurrency)", false, 0);
+    args.add<unsigned>("chunk", 'n', "No. of command sets synthesized at once", false, 1024);
+    args.parse_check(argc, argv);
+
+    stfmest::SynthesisDefaults defaults;
+    defaults.fs = args.get<double>("fs");
+    defaults.mub = args.get<double>("mub");
+    defaults.tailSec = args.get<double>("tail");
+
+    unsigned threadNum = args.get<unsigned>("jobs");
+    if (threadNum == 0) threadNum = std::max(std::thread::hardware_concurrency(), 1u);
+    unsigned chunkSize = std::max(args.get<unsigned>("chunk"), 1u);
+
+    std::ofstream out(args.get<std::string>("out"));
+    if (!out)
+    {
+        std::cerr << "Cannot open the output file." << std::endl;
+        exit(1);
+    }
+
+    stfmest::BatchSynthesizer synthesizer(threadNum, defaults);
+    std::vector<std::string> commandSets, contourLines;
+    unsigned long long contourNum = 0;
+    stfmest::Timer t;
+    t.start();
+
+    // Contours are written in the order of the command sets, chunk by chunk.
+    auto flush = [&]()
+    {
+        synthesizer.synthesize(commandSets, contourLines);
+        for (const auto &line : contourLines) out << line << '\n';
+        contourNum += commandSets.size();
+        commandSets.clear();
+    };
+
+    // A JSON lines file is read line by line.
+    // A JSON file has a command set or an array of command sets.
+    const std::string &inName = args.get<std::string>("in");
+    if (inName.size() > 6 && inName.substr(inName.size() - 6) == ".jsonl")
+    {
+        std::ifstream in(inName);
+        if (!in)
+        {
+            std::cerr << "Cannot open the input file." << std::endl;
+            exit(1);
+        }
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+            commandSets.push_back(line);
+            if (commandSets.size() >= chunkSize) flush();
+        }
+    }
+    else
+    {
+        nlohmann::json injson = jsonread(inName);
+        // An array of commands is a single command set.
+        if (injson.is_array() && (injson.empty() || !injson[0].count("FilterType")))
+        {
+            for (const auto &j : injson)
+            {
+                commandSets.push_back(j.dump());
+                if (commandSets.size() >= chunkSize) flush();
+            }
+        }
+        else
+        {
+            commandSets.push_back(injson.dump());
+        }
+    }
+    flush();
+    t.stop();
+
+    std::cout << "Synthesized " << contourNum << " contours (" << synthesizer.getFrameNum() << " frames, "
+              << synthesizer.getErrorNum() << " errors) with " << threadNum << " threads in "
+              << t.get() << " sec.: " << synthesizer.getFrameNum() / t.get() << " frames/sec." << std::endl;
+    return 0;
+}
@@ -20,11 +20,11 @@ namespace stfmest
             num_smallstates(duration.size()),
             attribute(attribute_)
         { ; }
-        inline int getAttribute() { return attribute; }
+        inline int getAttribute() const { return attribute; }
         inline void setAttribute(const int &attribute_) { attribute = attribute_; }
 
-        inline unsigned getSmallStateNum() { return num_smallstates; }
-        inline std::vector<double> getDurationDist() { return dist_duration; }
+        inline unsigned getSmallStateNum() const { return num_smallstates; }
+        inline std::vector<double> getDurationDist() const { return dist_duration; }
 
         inline std::string getStatus()
         {
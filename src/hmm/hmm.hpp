@@ -51,7 +51,7 @@ namespace stfmest
         {
             return transition_probs[i_st];
         }
-        inline BigState getBigState(unsigned bigstateNum) { return bigstates[bigstateNum]; }
+        inline const BigState &getBigState(unsigned bigstateNum) { return bigstates[bigstateNum]; }
         unsigned countByStateType(int keyAttribute); // count No. of big states which attribute matches.
     private:
         void _hmmInitialize();
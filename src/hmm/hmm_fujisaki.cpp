@@ -1,4 +1,5 @@
 #include "hmm_fujisaki.hpp"
+#include "error_codes.hpp"
 #include <iostream>
 
 using pair = std::pair<unsigned, double>;
@@ -153,19 +154,23 @@ namespace stfmest
     }
 
 
-    Hmm makeLoopFujisakiHmm(unsigned phraseBranchNum, unsigned accentBranchNum, const TransParams &st, unsigned margin_length)
+    Hmm makeLoopFujisakiHmm(unsigned phraseBranchNum, unsigned accentBranchNum, const TransParams &st, unsigned margin_length,
+                            int *status)
     {
         Hmm hmm;
+        if (status != nullptr) *status = NO_ERROR;
 
         if (phraseBranchNum < 1)
         {
             std::cerr << "No. of phrase states must be positive." << std::endl;
-            exit(1);
+            if (status != nullptr) *status = CONFIG_VALUE_INVALID;
+            return hmm;
         }
         if (accentBranchNum < 1)
         {
             std::cerr << "No. of accent states must be positive." << std::endl;
-            exit(1);
+            if (status != nullptr) *status = CONFIG_VALUE_INVALID;
+            return hmm;
         }
         vector<double> prob_rinf(margin_length, 1.0);
 
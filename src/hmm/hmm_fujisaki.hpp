@@ -42,17 +42,27 @@ namespace stfmest
     };
 
 
+    inline bool operator==(const TransParams &left, const TransParams &right)
+    {
+        return left.r0duration == right.r0duration && left.r1duration == right.r1duration
+            && left.acduration == right.acduration && left.phduration == right.phduration
+            && left.prob_ator0 == right.prob_ator0 && left.prob_ator1 == right.prob_ator1;
+    }
+
+
     void to_json(nlohmann::json &j, const TransParams &tp);
     void from_json(const nlohmann::json &j, TransParams &tp);
 
 
     // Make Loop HMM to estimate commands from F0
     // (implementation of [Kameoka+, 2015])
+    // An empty HMM if the branch No.'s are invalid, with CONFIG_VALUE_INVALID in *status.
     Hmm makeLoopFujisakiHmm(
         unsigned phraseBranchNum, // The num. of phrase-on big states.
         unsigned accentBranchNum, // The num. of accent-on big states.
         const TransParams &st,    // Information of hmm transition probs.
-        unsigned margin_length    // The possible maximum length of no-command section in the beginnig/ending.
+        unsigned margin_length,   // The possible maximum length of no-command section in the beginnig/ending.
+        int *status = nullptr
     );
 
 
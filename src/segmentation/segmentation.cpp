@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cmath>
+#include "segmentation.hpp"
+#include "error_codes.hpp"
+
+
+namespace stfmest
+{
+    std::vector<InputChunk> splitAtPauses(const InputData &id_, const SegmentationConfig &sc, double zeroThreshold)
+    {
+        unsigned frameNum = id_.logf0.size();
+        unsigned maxLen = std::max((unsigned)(sc.maxChunkSec * id_.fs), 1u);
+        unsigned minPause = std::max((unsigned)(sc.minPauseSec * id_.fs), 1u);
+        unsigned overlap = (unsigned)(sc.overlapSec * id_.fs);
+
+        // Middle of the unvoiced stretches inside the signal
+        std::vector<unsigned> candidates;
+        for (unsigned i=0; i<frameNum; )
+        {
+            if (id_.vuv[i] > zeroThreshold)
+            {
+                i++;
+                continue;
+            }
+            unsigned j = i;
+            while (j < frameNum && id_.vuv[j] <= zeroThreshold) j++;
+            if (i > 0 && j < frameNum && j - i >= minPause) candidates.push_back((i + j) / 2);
+            i = j;
+        }
+
+        // Cut as late as possible within maxLen, or at the first pause after it.
+        std::vector<unsigned> cuts{0};
+        while (frameNum - cuts.back() > maxLen)
+        {
+            unsigned start = cuts.back();
+            unsigned cut = 0;
+            for (unsigned c : candidates)
+            {
+                if (c <= start + 2 * overlap) continue; // too short chunk
+                if (c <= start + maxLen || cut == 0) cut = c;
+                if (c > start + maxLen) break;
+            }
+            if (cut == 0) break;
+            cuts.push_back(cut);
+        }
+        cuts.push_back(frameNum);
+
+        std::vector<InputChunk> chunks;
+        for (unsigned k=0; k+1<cuts.size(); k++)
+        {
+            InputChunk chunk;
+            chunk.coreBegin = cuts[k];
+            chunk.coreEnd = cuts[k+1];
+            chunk.frameBegin = chunk.coreBegin > overlap ? chunk.coreBegin - overlap : 0;
+            chunk.frameEnd = std::min(chunk.coreEnd + overlap, frameNum);
+            chunks.push_back(chunk);
+        }
+        return chunks;
+    }
+
+
+    InputData sliceInput(const InputData &id_, const InputChunk &chunk)
+    {
+        InputData slice;
+        slice.fs = id_.fs;
+        slice.initial_mub = id_.initial_mub;
+        auto cut = [&](const std::vector<double> &v)
+        {
+            return std::vector<double>(v.begin() + chunk.frameBegin, v.begin() + chunk.frameEnd);
+        };
+        slice.logf0 = cut(id_.logf0);
+        slice.vuv = cut(id_.vuv);
+        slice.initial_up = cut(id_.initial_up);
+        slice.initial_ua = cut(id_.initial_ua);
+        return slice;
+    }
+
+
+    // Commands of a chunk result in the time of the whole input
+    static std::vector<FujisakiCommand> _shiftedCommands(const EstimationResult &er, const InputChunk &chunk, double fs)
+    {
+        std::vector<FujisakiCommand> commands = er.commands;
+        for (auto &c : commands)
+        {
+            c.onset += chunk.frameBegin / fs;
+            c.offset += chunk.frameBegin / fs;
+        }
+        std::sort(commands.begin(), commands.end());
+        return commands;
+    }
+
+
+    // Amplitude of a phrase command that a chunk found before its core, usually the one at its start.
+    // The chunk was estimated without the earlier commands, so the command also carries their tail:
+    // the response of the kept phrase commands projected onto its own in the voiced core is subtracted.
+    static double _reconciledPhraseAmplitude(const std::vector<FujisakiCommand> &kept, const FujisakiCommand &phrase,
+                                             const InputData &id_, const InputChunk &chunk, double zeroThreshold)
+    {
+        std::vector<FujisakiCommand> keptPhrases;
+        for (const auto &c : kept) if (c.filtertype == CMD_PHRASE) keptPhrases.push_back(c);
+        std::vector<double> tail = criticalfilter(keptPhrases, 0.0, id_.fs, chunk.coreEnd);
+        std::vector<double> response = criticalfilter(phrase, id_.fs, chunk.coreEnd);
+
+        double product = 0.0, norm2 = 0.0;
+        for (unsigned i=chunk.coreBegin; i<chunk.coreEnd; i++)
+        {
+            if (id_.vuv[i] <= zeroThreshold) continue;
+            product += tail[i] * response[i];
+            norm2 += response[i] * response[i];
+        }
+        if (!(norm2 > 0.0)) return phrase.integratedAmplitude;
+        double explained = std::min(std::max(product / norm2, 0.0), 1.0); // ratio of the tail in the response
+        return phrase.integratedAmplitude * (1.0 - explained);
+    }
+
+
+    EstimationResult stitchResults(const InputData &id_, const std::vector<InputChunk> &chunks,
+                                   const std::vector<EstimationResult> &chunkResults,
+                                   const SegmentationConfig &sc, double zeroThreshold,
+                                   std::vector<ChunkBoundaryReport> &reports, int *status)
+    {
+        double fs = id_.fs;
+        unsigned frameNum = id_.logf0.size();
+        EstimationResult er;
+        er.mub = 0.0;
+        reports.clear();
+
+        std::vector<std::vector<FujisakiCommand> > shifted;
+        for (unsigned k=0; k<chunks.size(); k++) shifted.push_back(_shiftedCommands(chunkResults[k], chunks[k], fs));
+
+        for (unsigned k=0; k<chunks.size(); k++)
+        {
+            const InputChunk &chunk = chunks[k];
+            const EstimationResult &cr = chunkResults[k];
+            er.mub += cr.mub * (chunk.coreEnd - chunk.coreBegin) / frameNum;
+
+            for (unsigned i=chunk.coreBegin; i<chunk.coreEnd; i++)
+            {
+                unsigned local = i - chunk.frameBegin;
+                if (local < cr.mup.size()) er.mup.push_back(cr.mup[local]);
+                if (local < cr.mua.size()) er.mua.push_back(cr.mua[local]);
+                if (local < cr.bigs.size()) er.bigs.push_back(cr.bigs[local]);
+                if (local < cr.up.size()) er.up.push_back(cr.up[local]);
+                if (local < cr.ua.size()) er.ua.push_back(cr.ua[local]);
+            }
+
+            ChunkBoundaryReport report;
+            if (k > 0)
+            {
+                // Commands of both chunks in the overlap
+                double overlapBegin = chunk.frameBegin / fs;
+                double overlapEnd = chunks[k-1].frameEnd / fs;
+                std::vector<FujisakiCommand> left, right;
+                for (const auto &c : shifted[k-1]) if (c.onset >= overlapBegin && c.onset < overlapEnd) left.push_back(c);
+                for (const auto &c : shifted[k]) if (c.onset >= overlapBegin && c.onset < overlapEnd) right.push_back(c);
+                report.cutFrame = chunk.coreBegin;
+                report.coincidence = evaluateByDP(left, right, sc.allowedTimeLagSec, zeroThreshold);
+                report.mubDifference = cr.mub - chunkResults[k-1].mub;
+                for (const auto &c : report.coincidence)
+                {
+                    if (c.second.matchedNum != c.second.totalNumInReference
+                        || c.second.matchedNum != c.second.totalNumInEstimated)
+                    {
+                        report.isConsistent = false;
+                    }
+                }
+            }
+
+            for (const auto &c : shifted[k])
+            {
+                double onsetFrame = std::round(c.onset * fs);
+                bool isLeadingPhrase = k > 0 && onsetFrame < chunk.coreBegin && c.filtertype == CMD_PHRASE;
+                bool isOwned = (k == 0 || onsetFrame >= chunk.coreBegin)
+                               && (k + 1 == chunks.size() || onsetFrame < chunk.coreEnd);
+                if (!isOwned && !isLeadingPhrase) continue;
+
+                // A command overlapping the last kept one of the same type came from both chunks.
+                bool isOverlapping = false;
+                for (auto it = er.commands.rbegin(); it != er.commands.rend(); ++it)
+                {
+                    if (it->filtertype != c.filtertype) continue;
+                    isOverlapping = c.filtertype == CMD_ACCENT ? c.onset < it->offset
+                                                               : c.onset - it->onset < sc.allowedTimeLagSec;
+                    break;
+                }
+                if (isOverlapping && isLeadingPhrase) continue; // the left chunk's one is kept
+                if (isOverlapping)
+                {
+                    ++report.droppedNum;
+                    report.isConsistent = false;
+                    continue;
+                }
+                if (isLeadingPhrase)
+                {
+                    FujisakiCommand reconciled = c;
+                    reconciled.integratedAmplitude = _reconciledPhraseAmplitude(er.commands, c, id_, chunk, zeroThreshold);
+                    report.subtractedPhraseAmplitude += c.integratedAmplitude - reconciled.integratedAmplitude;
+                    if (reconciled.integratedAmplitude > zeroThreshold) er.commands.push_back(reconciled);
+                    continue;
+                }
+                er.commands.push_back(c);
+            }
+            if (k > 0) reports.push_back(report);
+        }
+
+        er.fs = fs;
+        int status_ = NO_ERROR;
+        er.regeneratedlf0 = criticalfilter(er.commands, er.mub, fs, frameNum, &status_);
+        if (status_ == NO_ERROR) er.rmse = rmse(id_.logf0, er.regeneratedlf0, id_.vuv, zeroThreshold, &status_);
+        if (status != nullptr) *status = status_;
+        er.voicedFrameNum = 0;
+        for (auto vuv : id_.vuv) if (vuv > zeroThreshold) ++(er.voicedFrameNum);
+        return er;
+    }
+}
@@ -0,0 +1,77 @@
+// Segmentation of long input signals at unvoiced pauses
+//
+// A long input is cut at the middle of long unvoiced stretches into chunks,
+// which overlap the neighbors and are estimated independently.
+// Each chunk owns the commands with the onset in its core (between the cuts),
+// and the commands found by both chunks in an overlap are compared
+// to report disagreements. The phrase command a chunk places at its start
+// is kept less the tail of the earlier phrase commands, which it also carries.
+
+#pragma once
+#include <utility>
+#include <vector>
+#include "json.hpp"
+#include "input_data.hpp"
+#include "fujisaki.hpp"
+#include "estimation_result.hpp"
+#include "evaluation.hpp"
+
+
+namespace stfmest
+{
+    struct SegmentationConfig
+    {
+        double maxChunkSec = 20.0; // chunks are cut to be shorter than this where possible
+        double minPauseSec = 0.3; // min. unvoiced stretch to be cut
+        double overlapSec = 0.5; // added to both sides of a cut
+        double allowedTimeLagSec = 0.1; // for matching the commands in an overlap
+    };
+
+
+    struct InputChunk
+    {
+        unsigned frameBegin; // frames [frameBegin, frameEnd) of the input
+        unsigned frameEnd;
+        unsigned coreBegin; // frames [coreBegin, coreEnd) owned by this chunk
+        unsigned coreEnd;
+    };
+
+
+    // Comparison of two chunks in the overlap around a cut
+    struct ChunkBoundaryReport
+    {
+        unsigned cutFrame;
+        std::vector<std::pair<FilterType, CommandsCoincidenceResult> > coincidence; // reference: the left chunk
+        int droppedNum = 0; // commands of the right chunk overlapping a kept one
+        double mubDifference = 0.0; // right - left
+        double subtractedPhraseAmplitude = 0.0; // from the right chunk's phrases before the cut, explained by the kept ones
+        bool isConsistent = true; // all commands in the overlap matched and none dropped
+    };
+
+
+    inline void to_json(nlohmann::json &j, const ChunkBoundaryReport &cbr)
+    {
+        j = nlohmann::json{{"cutFrame", cbr.cutFrame}, {"droppedNum", cbr.droppedNum},
+                        {"mubDifference", cbr.mubDifference},
+                        {"subtractedPhraseAmplitude", cbr.subtractedPhraseAmplitude},
+                        {"isConsistent", cbr.isConsistent}, {"coincidence", nlohmann::json::array()}};
+        for (const auto &c : cbr.coincidence)
+        {
+            j["coincidence"].push_back(nlohmann::json{{"FilterType", (int)c.first}, {"result", c.second}});
+        }
+    }
+
+
+    // One chunk for the whole input if no cut is needed.
+    std::vector<InputChunk> splitAtPauses(const InputData &id_, const SegmentationConfig &sc, double zeroThreshold);
+
+    InputData sliceInput(const InputData &id_, const InputChunk &chunk);
+
+    // Result for the whole input. regeneratedlf0 is synthesized from the stitched commands
+    // with mub averaged over the chunks; mup, mua, bigs, up and ua are taken from the cores.
+    // The status of the synthesis and the RMSE (see error_codes.hpp) is set in *status if given.
+    EstimationResult stitchResults(const InputData &id_, const std::vector<InputChunk> &chunks,
+                                   const std::vector<EstimationResult> &chunkResults,
+                                   const SegmentationConfig &sc, double zeroThreshold,
+                                   std::vector<ChunkBoundaryReport> &reports, int *status = nullptr);
+}
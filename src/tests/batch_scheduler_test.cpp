@@ -0,0 +1,133 @@
+// Invariants of BatchScheduler: admission within the memory budget, a job which does not
+// fit alone runs alone, overtaking is bounded, and every job is started once.
+
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <random>
+#include <thread>
+#include "batch_scheduler.hpp"
+#include "check.hpp"
+
+using namespace stfmest;
+
+
+// True if acquire() of the scheduler is still blocked after a while
+static bool isBlocked(std::future<int> &job)
+{
+    return job.wait_for(std::chrono::milliseconds(50)) == std::future_status::timeout;
+}
+
+
+static void checkScripted(TestChecker &checker)
+{
+    // 2 workers: the first pending job is overtaken at most 4 times.
+    BatchScheduler scheduler(2, 100, {60, 60, 10, 10, 10, 10, 10, 10});
+    checker.check(scheduler.acquire(0) == 0, "overtaking: first job");
+    int job = scheduler.acquire(0);
+    checker.check(job == 2, "overtaking: a small job instead of the one not fitting");
+    for (int next : {3, 4, 5})
+    {
+        scheduler.release(job, 0, 0);
+        job = scheduler.acquire(0);
+        checker.check(job == next, "overtaking: job " + std::to_string(next));
+    }
+    scheduler.release(job, 0, 0);
+    std::future<int> waiting = std::async(std::launch::async, [&]() { return scheduler.acquire(0); });
+    checker.check(isBlocked(waiting), "overtaking: bounded");
+    scheduler.release(0, 0, 0);
+    checker.check(waiting.get() == 1, "overtaking: the deferred job after the others drain");
+    checker.check(scheduler.acquire(0) == 6, "overtaking: the rest in order");
+    scheduler.release(1, 0, 0);
+    scheduler.release(6, 0, 0);
+    checker.check(scheduler.acquire(0) == 7, "overtaking: last job");
+    scheduler.release(7, 0, 0);
+    checker.check(scheduler.acquire(0) == -1, "overtaking: no job left");
+
+    // A job larger than the budget runs alone.
+    BatchScheduler alone(2, 100, {150, 10});
+    checker.check(!alone.fitsAlone(0) && alone.fitsAlone(1), "alone: fitsAlone");
+    checker.check(alone.acquire(0) == 0, "alone: started while nothing runs");
+    waiting = std::async(std::launch::async, [&]() { return alone.acquire(0); });
+    checker.check(isBlocked(waiting), "alone: nothing else runs with it");
+    alone.release(0, 0, 0);
+    checker.check(waiting.get() == 1, "alone: the next one after it");
+    alone.release(1, 0, 0);
+
+    // The bytes retained by an idle worker count; a worker's own retained bytes are reused.
+    BatchScheduler retained(3, 100, {50, 50, 40, 50});
+    checker.check(retained.acquire(0) == 0 && retained.acquire(0) == 1, "retained: two jobs fit");
+    retained.release(0, 0, 50); // 50 running + 50 retained
+    waiting = std::async(std::launch::async, [&]() { return retained.acquire(0); });
+    checker.check(isBlocked(waiting), "retained: a new worker does not fit");
+    checker.check(retained.acquire(50) == 2, "retained: the idle worker reuses its bytes"); // 50 + max(50, 40)
+    retained.release(2, 50, 0); // the worker drops its estimator: 50 running
+    checker.check(waiting.get() == 3, "retained: fits after the bytes are given back");
+    retained.release(1, 0, 0);
+    retained.release(3, 0, 0);
+    checker.check(retained.acquire(0) == -1, "retained: no job left");
+}
+
+
+// Workers with random job sizes; the memory in use is accounted by the test itself.
+static void checkThreaded(TestChecker &checker)
+{
+    const unsigned workerNum = 4;
+    const unsigned long long budget = 1000;
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<unsigned long long> size(10, 600);
+    std::vector<unsigned long long> predicted(300);
+    for (auto &p : predicted) p = size(rng);
+    predicted[10] = 1500; // larger than the budget
+
+    BatchScheduler scheduler(workerNum, budget, predicted);
+    std::mutex mtx;
+    std::vector<unsigned> startNum(predicted.size(), 0);
+    unsigned long long usedBytes = 0; // running: max(retained, predicted), idle: retained
+    unsigned runningNum = 0;
+    unsigned violationNum = 0;
+
+    auto work = [&](unsigned worker)
+    {
+        std::mt19937 workerRng(worker);
+        unsigned long long retainedBytes = 0;
+        for (int job = scheduler.acquire(retainedBytes); job >= 0; job = scheduler.acquire(retainedBytes))
+        {
+            unsigned long long jobBytes = std::max(retainedBytes, predicted[job]);
+            {
+                // Counted after the admission, and given back before the release below.
+                std::lock_guard<std::mutex> lock(mtx);
+                ++startNum[job];
+                ++runningNum;
+                usedBytes += jobBytes - retainedBytes;
+                if (usedBytes > budget && runningNum > 1) ++violationNum;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(workerRng() % 300));
+            unsigned long long retainedBefore = retainedBytes;
+            retainedBytes = workerRng() % 2 ? jobBytes : 0; // keeps or drops the estimator
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                --runningNum;
+                usedBytes -= jobBytes - retainedBytes;
+            }
+            scheduler.release(job, retainedBefore, retainedBytes);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned w=0; w<workerNum; w++) threads.push_back(std::thread(work, w));
+    for (auto &t : threads) t.join();
+
+    unsigned notOnceNum = 0;
+    for (auto n : startNum) notOnceNum += n != 1;
+    checker.check(notOnceNum == 0, "threaded: every job started once");
+    checker.check(violationNum == 0, "threaded: within the budget (" + std::to_string(violationNum) + " violations)");
+}
+
+
+int main()
+{
+    TestChecker checker;
+    checkScripted(checker);
+    checkThreaded(checker);
+    return checker.result();
+}
@@ -0,0 +1,56 @@
+// Checks shared by the tests
+//
+// Each test is an executable run by ctest, which prints the failed checks
+// and returns 1 if any of them failed.
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+namespace stfmest
+{
+    class TestChecker
+    {
+    public:
+        inline bool check(bool condition, const std::string &what)
+        {
+            if (!condition)
+            {
+                std::cerr << "FAILED: " << what << std::endl;
+                ++failureNum;
+            }
+            return condition;
+        }
+
+        // max |actual - expected| <= tolerance * max(max |expected|, 1)
+        inline bool checkClose(const std::vector<double> &actual, const std::vector<double> &expected,
+                               double tolerance, const std::string &what)
+        {
+            if (!check(actual.size() == expected.size(), what + ": size")) return false;
+            double maxError = 0.0, scale = 1.0;
+            for (unsigned i=0; i<expected.size(); i++)
+            {
+                maxError = std::max(maxError, std::fabs(actual[i] - expected[i]));
+                scale = std::max(scale, std::fabs(expected[i]));
+            }
+            if (maxError > tolerance * scale)
+            {
+                std::cerr << "  max. error " << maxError << " (scale " << scale << ")" << std::endl;
+            }
+            return check(maxError <= tolerance * scale, what);
+        }
+
+        inline int result() const
+        {
+            if (failureNum == 0) std::cout << "All checks passed." << std::endl;
+            return failureNum == 0 ? 0 : 1;
+        }
+
+    private:
+        unsigned failureNum = 0;
+    };
+}
@@ -0,0 +1,100 @@
+// The sparse constraint log probs. of imposeStochasticConst against a dense
+// frame x small state matrix made by scanning the small states of each accent.
+
+#include <set>
+#include "em_estimation.hpp"
+#include "external_constraint.hpp"
+#include "demo_data.hpp"
+#include "gmm_reference.hpp"
+#include "check.hpp"
+
+using namespace stfmest;
+
+
+int main(int argc, char *argv[])
+{
+    TestChecker checker;
+    DemoData demo = loadDemoData(argc > 1 ? argv[1] : "demo");
+    std::vector<StochasticCommandConstraint> sccs = demoConstraints();
+    EmEstimationConstrained em(demo.config);
+    if (!checker.check(prepareDemo(em, demo, &sccs) == NO_ERROR, "validate")) return checker.result();
+
+    std::vector<std::vector<double> > sparse = em.getConstraintProb();
+    std::vector<SmallState> smallStates = em.getSmallStates();
+    unsigned frameNum = demo.input.logf0.size();
+    unsigned stateNum = smallStates.size();
+
+    // Accent big states in the order of their No's, the same No. of branches per constraint
+    std::set<int> accentBigStateSet;
+    for (const auto &ss : smallStates) if (ss.attribute == STATE_ACCENT) accentBigStateSet.insert(ss.bigstateId);
+    std::vector<int> accentBigStates(accentBigStateSet.begin(), accentBigStateSet.end());
+    unsigned branchNum = accentBigStates.size() / sccs.size();
+    if (!checker.check(branchNum > 0 && accentBigStates.size() == sccs.size() * branchNum, "accent big states")) return checker.result();
+
+    // dense[frame][state]: NAN if not constrained; isPruned if below the threshold
+    std::vector<std::vector<double> > dense(frameNum, std::vector<double>(stateNum, NAN));
+    std::vector<std::vector<bool> > isPruned(frameNum, std::vector<bool>(stateNum, false));
+    for (unsigned iAcc=0; iAcc<sccs.size(); iAcc++)
+    {
+        const StochasticCommandConstraint &c = sccs[iAcc];
+        std::vector<double> onset = denseGmmLogDensity(c.onBasetime, c.onWeights, c.onMeans, c.onSigmas, frameNum, demo.input.fs);
+        std::vector<double> offset = denseGmmLogDensity(c.offBasetime, c.offWeights, c.offMeans, c.offSigmas, frameNum, demo.input.fs);
+        double onsetFloor = *std::max_element(onset.begin(), onset.end()) - 4.6;
+        double offsetFloor = *std::max_element(offset.begin(), offset.end()) - 4.6;
+
+        for (unsigned iBranch=0; iBranch<branchNum; iBranch++)
+        {
+            int bigState = accentBigStates[iAcc * branchNum + iBranch];
+            unsigned first = stateNum, last = stateNum;
+            for (unsigned iSs=0; iSs<stateNum; iSs++)
+            {
+                if (smallStates[iSs].bigstateId != bigState) continue;
+                if (first == stateNum) first = iSs;
+                last = iSs;
+            }
+            // onset at iFr: just before the accent at iFr-1; offset at iFr: at the end of the accent at iFr+1
+            for (unsigned prev : smallStates[first].backwardConnects)
+            {
+                for (unsigned iFr=1; iFr<frameNum; iFr++)
+                {
+                    dense[iFr-1][prev] = onset[iFr];
+                    isPruned[iFr-1][prev] = onset[iFr] < onsetFloor;
+                }
+            }
+            for (unsigned iFr=0; iFr+1<frameNum; iFr++)
+            {
+                dense[iFr+1][last] = offset[iFr];
+                isPruned[iFr+1][last] = offset[iFr] < offsetFloor;
+            }
+        }
+    }
+
+    // The values matter only where the cells are not pruned.
+    unsigned comparedNum = 0, mismatchNum = 0, unconstrainedNum = 0;
+    for (unsigned iFr=0; iFr<frameNum; iFr++)
+    {
+        for (unsigned iSs=0; iSs<stateNum; iSs++)
+        {
+            if (std::isnan(dense[iFr][iSs]))
+            {
+                if (sparse[iFr][iSs] != 0.0) ++unconstrainedNum;
+                continue;
+            }
+            if (isPruned[iFr][iSs]) continue;
+            ++comparedNum;
+            if (std::fabs(sparse[iFr][iSs] - dense[iFr][iSs]) > 1e-9 * std::max(std::fabs(dense[iFr][iSs]), 1.0)) ++mismatchNum;
+        }
+    }
+    checker.check(comparedNum > 0, "constrained cells");
+    checker.check(mismatchNum == 0, "log probs. of the constrained cells (" + std::to_string(mismatchNum) + " differ)");
+    checker.check(unconstrainedNum == 0, "unconstrained cells are 0 (" + std::to_string(unconstrainedNum) + " are not)");
+
+    // Imposing again replaces the constraints.
+    std::vector<StochasticCommandConstraint> none;
+    em.imposeStochasticConst(none);
+    unsigned remainingNum = 0;
+    for (const auto &row : em.getConstraintProb()) for (double v : row) remainingNum += v != 0.0;
+    checker.check(remainingNum == 0, "cleared");
+
+    return checker.result();
+}
@@ -0,0 +1,66 @@
+// Demo data (demo/config.json, hmmprob.json and input.json) for the tests of the estimation
+
+#pragma once
+#include <string>
+#include <vector>
+#include "iofile.hpp"
+#include "estimation_config.hpp"
+#include "hmm_fujisaki.hpp"
+#include "input_data.hpp"
+#include "external_constraint.hpp"
+#include "estimator.hpp"
+#include "error_codes.hpp"
+
+
+namespace stfmest
+{
+    struct DemoData
+    {
+        EstimationConfig config;
+        TransParams hmmprob;
+        InputData input;
+    };
+
+
+    inline DemoData loadDemoData(const std::string &dir)
+    {
+        DemoData demo;
+        demo.config = jsonread(dir + "/config.json");
+        demo.hmmprob = jsonread(dir + "/hmmprob.json");
+        nlohmann::json input = jsonread(dir + "/input.json");
+        demo.input = input.is_array() ? input.at(0) : input;
+        return demo;
+    }
+
+
+    // Constraints on the first and the last accent commands of the demo input
+    inline std::vector<StochasticCommandConstraint> demoConstraints()
+    {
+        StochasticCommandConstraint first, last;
+        first.onBasetime = 0.40;
+        first.offBasetime = 1.00;
+        first.onWeights = {0.6, 0.4};
+        first.onMeans = {0.0, 0.03};
+        first.onSigmas = {0.03, 0.05};
+        first.offWeights = {1.0};
+        first.offMeans = {0.0};
+        first.offSigmas = {0.04};
+        last.onBasetime = 1.58;
+        last.offBasetime = 2.50;
+        last.onWeights = {1.0};
+        last.onMeans = {0.0};
+        last.onSigmas = {0.04};
+        last.offWeights = {0.5, 0.5};
+        last.offMeans = {-0.02, 0.02};
+        last.offSigmas = {0.03, 0.03};
+        return {first, last};
+    }
+
+
+    // Prepares em for the demo input as Estimator::estimate() does (see Estimator::prepare). Returns validate().
+    inline int prepareDemo(EmEstimationConstrained &em, const DemoData &demo,
+                           const std::vector<StochasticCommandConstraint> *constraints)
+    {
+        return Estimator(demo.config, demo.hmmprob).prepare(em, demo.input, constraints);
+    }
+}
@@ -0,0 +1,74 @@
+// Heap allocations in the EM iterations, counted by replacing the global operator new.
+// All buffers are allocated in the first iteration, so launch() allocates
+// as many times for a few iterations as for one.
+
+#include <cstdlib>
+#include <new>
+#include "em_estimation.hpp"
+#include "external_constraint.hpp"
+#include "demo_data.hpp"
+#include "check.hpp"
+
+using namespace stfmest;
+
+
+static unsigned long long allocationNum = 0;
+
+void *operator new(std::size_t size)
+{
+    ++allocationNum;
+    void *p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+#endif
+
+
+// No. of allocations in launch() with iterationNum, or -1 if failed
+static long long countLaunchAllocations(const DemoData &demo, const std::vector<StochasticCommandConstraint> *constraints,
+                                        int iterationNum)
+{
+    DemoData demo_ = demo;
+    demo_.config.iterationNum = iterationNum;
+    EmEstimationConstrained em(demo_.config);
+    if (prepareDemo(em, demo_, constraints) != NO_ERROR) return -1;
+    unsigned long long before = allocationNum;
+    int status = em.launch();
+    unsigned long long after = allocationNum;
+    return status == NO_ERROR ? (long long)(after - before) : -1;
+}
+
+
+static void checkAllocations(TestChecker &checker, const DemoData &demo,
+                             const std::vector<StochasticCommandConstraint> *constraints, const std::string &what)
+{
+    long long once = countLaunchAllocations(demo, constraints, 1);
+    long long more = countLaunchAllocations(demo, constraints, 5);
+    if (!checker.check(once >= 0 && more >= 0, what + ": launch")) return;
+    if (!checker.check(more == once, what + ": allocations in iterations 2-5")) // per iteration
+    {
+        std::cerr << "  " << (more - once) / 4.0 << " per iteration" << std::endl;
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    TestChecker checker;
+    DemoData demo = loadDemoData(argc > 1 ? argv[1] : "demo");
+    std::vector<StochasticCommandConstraint> constraints = demoConstraints();
+    checkAllocations(checker, demo, nullptr, "without constraints");
+    checkAllocations(checker, demo, &constraints, "with constraints");
+    return checker.result();
+}
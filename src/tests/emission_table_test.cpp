@@ -0,0 +1,56 @@
+// The emission table of the E step (log output probs. per frame and big state,
+// plus the sparse constraints) against the dense formula per frame and small state.
+
+#include "em_estimation.hpp"
+#include "external_constraint.hpp"
+#include "demo_data.hpp"
+#include "check.hpp"
+
+using namespace stfmest;
+
+
+static void checkEmission(TestChecker &checker, const DemoData &demo,
+                          const std::vector<StochasticCommandConstraint> *constraints, const std::string &what)
+{
+    EmEstimationConstrained em(demo.config);
+    if (!checker.check(prepareDemo(em, demo, constraints) == NO_ERROR, what + ": validate")) return;
+    EstimationResult er;
+    checker.check(em.launch() == NO_ERROR, what + ": launch");
+    checker.check(em.getResult(er) == NO_ERROR, what + ": getResult"); // E step at the final up/ua
+
+    std::vector<std::vector<double> > emission = em.getEmissionProb();
+    std::vector<std::vector<double> > constraint = em.getConstraintProb();
+    std::vector<SmallState> smallStates = em.getSmallStates();
+    unsigned frameNum = demo.input.logf0.size();
+    if (!checker.check(emission.size() == frameNum && constraint.size() == frameNum, what + ": frame No.")) return;
+
+    double invsigma2_p = 1.0 / demo.config.defaultSigmap2;
+    double invsigma2_a = 1.0 / demo.config.defaultSigmaa2;
+    double tolerance = sizeof(Real) == sizeof(double) ? 1e-12 : 1e-6;
+    bool hasConstraint = false;
+    for (unsigned i_fr=0; i_fr<frameNum; i_fr++)
+    {
+        std::vector<double> expected(smallStates.size());
+        for (unsigned i_st=0; i_st<smallStates.size(); i_st++)
+        {
+            unsigned i_big = smallStates[i_st].bigstateId;
+            expected[i_st] = -0.5 * (er.up[i_fr] - er.Cp[i_big]) * (er.up[i_fr] - er.Cp[i_big]) * invsigma2_p
+                             -0.5 * (er.ua[i_fr] - er.Ca[i_big]) * (er.ua[i_fr] - er.Ca[i_big]) * invsigma2_a
+                             + constraint[i_fr][i_st];
+            hasConstraint = hasConstraint || constraint[i_fr][i_st] != 0.0;
+        }
+        if (!checker.checkClose(emission[i_fr], expected, tolerance, what + ": frame " + std::to_string(i_fr))) return;
+    }
+    checker.check(hasConstraint == (constraints != nullptr), what + ": constraints imposed");
+}
+
+
+int main(int argc, char *argv[])
+{
+    TestChecker checker;
+    DemoData demo = loadDemoData(argc > 1 ? argv[1] : "demo");
+    std::vector<StochasticCommandConstraint> constraints = demoConstraints();
+    checkEmission(checker, demo, nullptr, "without constraints");
+    checkEmission(checker, demo, &constraints, "with constraints");
+    return checker.result();
+}
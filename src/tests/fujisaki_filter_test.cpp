@@ -0,0 +1,83 @@
+// The recursive filters of excitations (addFilteredExcitation and the transposed one)
+// against the direct convolution with the sampled kernel, stored in double or float
+// as the EM algorithm stores it (see precision.hpp).
+
+#include <random>
+#include <sstream>
+#include "fujisaki.hpp"
+#include "check.hpp"
+
+using namespace stfmest;
+
+
+// y[k] += sum_{l<=k} G[k-l] u[l], or y[l] += sum_{k>=l} G[k-l] u[k] if transposed
+template <class T>
+static void convolve(const std::vector<double> &u, double omega, double fs, bool isTransposed, std::vector<double> &y)
+{
+    std::vector<T> kernel(y.size());
+    for (unsigned i=0; i<kernel.size(); i++) kernel[i] = (T)(impulse_response(omega, i / fs) / fs);
+    for (unsigned k=0; k<y.size(); k++)
+    {
+        for (unsigned l=0; l<=k; l++)
+        {
+            if (isTransposed) y[l] += (double)kernel[k-l] * u[k];
+            else y[k] += (double)kernel[k-l] * u[l];
+        }
+    }
+}
+
+
+// Rectangular excitations like up/ua, on the regularizer offset
+static std::vector<double> excitation(unsigned frameNum, std::mt19937 &rng)
+{
+    std::vector<double> u(frameNum, 1e-4);
+    std::uniform_real_distribution<double> amplitude(0.05, 0.8);
+    std::uniform_int_distribution<unsigned> length(1, std::max(frameNum / 8, 1u));
+    for (unsigned begin=frameNum/10; begin<frameNum; )
+    {
+        unsigned end = std::min(begin + length(rng), frameNum);
+        double a = amplitude(rng);
+        for (unsigned i=begin; i<end; i++) u[i] = a;
+        begin = end + length(rng);
+    }
+    return u;
+}
+
+
+int main()
+{
+    TestChecker checker;
+    std::mt19937 rng(1);
+
+    for (double fs : {100.0, 125.0, 200.0, 1000.0})
+    {
+        for (double omega : {1.0, 3.0, 20.0, 60.0})
+        {
+            unsigned frameNum = (unsigned)(3.0 * fs);
+            std::vector<double> u = excitation(frameNum, rng);
+            std::vector<double> y0(frameNum, 0.3); // the outputs are added
+
+            for (bool isTransposed : {false, true})
+            {
+                std::vector<double> recursive = y0, direct = y0, directFloat = y0;
+                if (isTransposed) addFilteredExcitationTransposed(u, omega, fs, recursive);
+                else addFilteredExcitation(u, omega, fs, recursive);
+                convolve<double>(u, omega, fs, isTransposed, direct);
+                convolve<float>(u, omega, fs, isTransposed, directFloat);
+
+                std::ostringstream what;
+                what << (isTransposed ? "transposed" : "forward") << " filter, omega " << omega << ", fs " << fs;
+                checker.checkClose(recursive, direct, 1e-9, what.str() + ", double kernel");
+                checker.checkClose(recursive, directFloat, 1e-5, what.str() + ", float kernel");
+            }
+        }
+    }
+
+    // Nothing is added to a single frame (the kernel is 0 at lag 0).
+    std::vector<double> y(1, 0.5);
+    addFilteredExcitation(std::vector<double>(1, 1.0), 3.0, 200.0, y);
+    addFilteredExcitationTransposed(std::vector<double>(1, 1.0), 3.0, 200.0, y);
+    checker.check(y[0] == 0.5, "single frame");
+
+    return checker.result();
+}
@@ -0,0 +1,77 @@
+// FujisakiSynthesizer (sampled kernel tables, cut at the horizon) against
+// the responses evaluated directly at each frame.
+
+#include <random>
+#include <sstream>
+#include "fujisaki.hpp"
+#include "fujisaki_synthesizer.hpp"
+#include "error_codes.hpp"
+#include "check.hpp"
+
+using namespace stfmest;
+
+
+static std::vector<double> directContour(const std::vector<FujisakiCommand> &commands, double mub, double fs, unsigned frameNum)
+{
+    std::vector<double> output(frameNum, mub);
+    for (const auto &c : commands)
+    {
+        bool isImpulse = (c.offset - c.onset) * c.omega < 0.01;
+        double amplitude = isImpulse ? c.integratedAmplitude : c.integratedAmplitude / (c.offset - c.onset);
+        for (unsigned i=0; i<frameNum; i++)
+        {
+            double t = (double)i / fs;
+            if (isImpulse) output[i] += impulse_response(c.omega, t - c.onset) * amplitude;
+            else output[i] += (step_response(c.omega, t - c.onset) - step_response(c.omega, t - c.offset)) * amplitude;
+        }
+    }
+    return output;
+}
+
+
+int main()
+{
+    TestChecker checker;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    FujisakiSynthesizer synthesizer; // the tables are kept over the cases
+
+    for (double fs : {100.0, 125.0, 200.0})
+    {
+        // Shorter signals first, so that the tables grow.
+        for (double lengthSec : {0.5, 4.0, 10.0})
+        {
+            unsigned frameNum = (unsigned)(lengthSec * fs);
+            std::vector<FujisakiCommand> commands;
+            // Phrase commands: impulse-like, also before the signal and between frames
+            for (double onset : {-0.3, 0.0, 0.37 / fs, 0.4 * lengthSec, lengthSec + 0.1})
+            {
+                commands.push_back(FujisakiCommand(CMD_PHRASE, onset, onset, 0.2 + 0.5 * uniform(rng), 3.0));
+            }
+            // Accent commands: rectangular, some cut by the end of the signal
+            for (double onset=0.05; onset<lengthSec + 0.5; onset+=0.2 + uniform(rng))
+            {
+                double offset = onset + 0.05 + 0.4 * uniform(rng);
+                commands.push_back(FujisakiCommand(CMD_ACCENT, onset, offset, 0.1 + 0.3 * uniform(rng), 20.0));
+            }
+
+            std::vector<double> contour(frameNum);
+            int status = synthesizer.synthesize(commands, 4.5, fs, contour);
+            std::ostringstream what;
+            what << "fs " << fs << ", " << lengthSec << " sec";
+            checker.check(status == NO_ERROR, what.str() + ": status");
+            checker.checkClose(contour, directContour(commands, 4.5, fs, frameNum), 1e-9, what.str());
+        }
+    }
+
+    // An invalid command is skipped and reported; the others are added.
+    std::vector<FujisakiCommand> commands{FujisakiCommand(CMD_ACCENT, 0.5, 0.4, 0.3, 20.0),
+                                          FujisakiCommand(CMD_PHRASE, 0.1, 0.1, 0.5, 3.0)};
+    std::vector<double> contour(200);
+    int status = synthesizer.synthesize(commands, 0.0, 200.0, contour);
+    checker.check(status == VALUE_INVALID, "invalid command: status");
+    commands.erase(commands.begin());
+    checker.checkClose(contour, directContour(commands, 0.0, 200.0, 200), 1e-9, "invalid command: others");
+
+    return checker.result();
+}
@@ -0,0 +1,87 @@
+// GmmFrameEvaluator (evaluated only in the window above the pruning threshold)
+// against the log densities at every frame.
+
+#include <sstream>
+#include "external_constraint.hpp"
+#include "gmm_reference.hpp"
+#include "check.hpp"
+
+using namespace stfmest;
+
+
+struct GmmCase
+{
+    double basetime;
+    std::vector<double> weights, means, sigmas;
+};
+
+
+int main()
+{
+    TestChecker checker;
+    const double pruneThreshold = 4.6;
+    std::vector<GmmCase> cases{
+        {0.40, {0.6, 0.4}, {0.0, 0.03}, {0.03, 0.05}},
+        {2.50, {0.5, 0.5}, {-0.02, 0.02}, {0.03, 0.03}},
+        {1.00, {0.5, 0.5}, {-0.3, 0.3}, {0.02, 0.02}}, // two modes with a pruned gap
+        {1.00, {0.9, 0.1}, {0.0, 0.5}, {0.01, 0.2}}, // a narrow peak and a wide low one
+        {1.00, {1.0, 0.0}, {0.0, 0.5}, {0.05, 0.05}}, // a component of weight 0
+        {1.00, {1.0, 0.0}, {0.0, 0.1}, {0.05, 0.001}}, // a sharp one of weight 0 in the window
+        {0.02, {1.0}, {0.0}, {0.05}}, // cut by the beginning of the signal
+        {3.18, {1.0}, {0.0}, {0.05}}, // cut by the end
+        {-1.0, {1.0}, {0.0}, {0.05}}, // maximum before the signal
+    };
+
+    for (double fs : {100.0, 125.0, 200.0})
+    {
+        unsigned frameNum = (unsigned)(3.2 * fs);
+        GmmFrameEvaluator evaluator(frameNum, fs, pruneThreshold); // the buffers are kept over the cases
+        for (unsigned i=0; i<cases.size(); i++)
+        {
+            const GmmCase &c = cases[i];
+            GmmFrameLogDensity result;
+            evaluator.evaluate(c.basetime, c.weights, c.means, c.sigmas, result);
+            std::vector<double> dense = denseGmmLogDensity(c.basetime, c.weights, c.means, c.sigmas, frameNum, fs);
+            double maxLogprob = *std::max_element(dense.begin(), dense.end());
+
+            std::ostringstream what;
+            what << "case " << i << ", fs " << fs;
+            checker.check(std::fabs(result.maxLogprob - maxLogprob) <= 1e-9 * std::max(std::fabs(maxLogprob), 1.0),
+                          what.str() + ": max.");
+            checker.check(result.frameEnd <= frameNum && result.logprob.size() == result.frameEnd - result.frameBegin,
+                          what.str() + ": window");
+            if (result.frameEnd > frameNum || result.logprob.size() != result.frameEnd - result.frameBegin) continue;
+
+            std::vector<double> window(dense.begin() + result.frameBegin, dense.begin() + result.frameEnd);
+            checker.checkClose(result.logprob, window, 1e-9, what.str() + ": log density");
+            // Exactly the frames below the threshold are pruned.
+            unsigned mismatchNum = 0;
+            for (unsigned i_fr=0; i_fr<frameNum; i_fr++)
+            {
+                if (result.isPruned(i_fr) != (dense[i_fr] < maxLogprob - pruneThreshold)) ++mismatchNum;
+            }
+            checker.check(mismatchNum == 0, what.str() + ": pruned frames");
+        }
+    }
+
+    // All the GMMs of the constraints in one call
+    std::vector<StochasticCommandConstraint> sccs(2);
+    sccs[0] = StochasticCommandConstraint{0.40, 1.00, {0.6, 0.4}, {1.0}, {0.0, 0.03}, {0.0}, {0.03, 0.05}, {0.04}};
+    sccs[1] = StochasticCommandConstraint{1.58, 2.50, {1.0}, {0.5, 0.5}, {0.0}, {-0.02, 0.02}, {0.04}, {0.03, 0.03}};
+    GmmFrameEvaluator evaluator(400, 125.0, pruneThreshold);
+    std::vector<GmmFrameLogDensity> onsets, offsets;
+    evaluator.evaluate(sccs, onsets, offsets);
+    checker.check(onsets.size() == 2 && offsets.size() == 2, "constraints: size");
+    for (unsigned i=0; i<onsets.size() && i<offsets.size(); i++)
+    {
+        GmmFrameLogDensity onset, offset;
+        evaluator.evaluate(sccs[i].onBasetime, sccs[i].onWeights, sccs[i].onMeans, sccs[i].onSigmas, onset);
+        evaluator.evaluate(sccs[i].offBasetime, sccs[i].offWeights, sccs[i].offMeans, sccs[i].offSigmas, offset);
+        checker.check(onsets[i].frameBegin == onset.frameBegin && onsets[i].logprob == onset.logprob,
+                      "constraints: onset " + std::to_string(i));
+        checker.check(offsets[i].frameBegin == offset.frameBegin && offsets[i].logprob == offset.logprob,
+                      "constraints: offset " + std::to_string(i));
+    }
+
+    return checker.result();
+}
@@ -0,0 +1,39 @@
+// Log densities of the constraint GMMs at every frame, evaluated directly
+// as a reference for GmmFrameEvaluator and the constraint imposition
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+namespace stfmest
+{
+    inline std::vector<double> denseGmmLogDensity(double basetime, const std::vector<double> &weights,
+                                                  const std::vector<double> &means, const std::vector<double> &sigmas,
+                                                  unsigned frameNum, double fs)
+    {
+        std::vector<double> logprob(frameNum);
+        for (unsigned i_fr=0; i_fr<frameNum; i_fr++)
+        {
+            double t_diff = (double)i_fr / fs - basetime;
+            double maxPower = -INFINITY;
+            std::vector<double> powers(weights.size());
+            for (unsigned i=0; i<weights.size(); i++)
+            {
+                powers[i] = -0.5 * (t_diff - means[i]) * (t_diff - means[i]) / sigmas[i] / sigmas[i];
+                if (weights[i] > 0.0) maxPower = std::max(maxPower, powers[i]);
+            }
+            double sum = 0.0;
+            for (unsigned i=0; i<weights.size(); i++)
+            {
+                sum += weights[i] / std::sqrt(2.0 * M_PI) / sigmas[i] * std::exp(powers[i] - maxPower);
+            }
+            logprob[i_fr] = std::log(sum) + maxPower;
+        }
+        return logprob;
+    }
+}
@@ -0,0 +1,112 @@
+// The incremental update of the reachable cells against the full sweep
+// (_updateReachableStateInfo) after removing the same cells.
+
+#include <random>
+#include "em_estimation.hpp"
+#include "external_constraint.hpp"
+#include "demo_data.hpp"
+#include "check.hpp"
+
+using namespace stfmest;
+
+
+class ReachabilityProbe : public EmEstimationConstrained
+{
+public:
+    explicit ReachabilityProbe(const EstimationConfig &ec): EmEstimationConstrained(ec) {}
+
+    std::vector<std::vector<bool> > getReachable() const
+    {
+        return std::vector<std::vector<bool> >(isReachable.begin(), isReachable.begin() + frameNum);
+    }
+    unsigned getStateNum() const { return stateNum; }
+    unsigned getFrameNum() const { return frameNum; }
+    void restrict(unsigned smallstatenum, unsigned frameBegin, unsigned frameEnd)
+    {
+        _restrictStateFrames(smallstatenum, frameBegin, frameEnd);
+    }
+    void sweep(const std::vector<std::pair<unsigned, unsigned> > &removedCells)
+    {
+        for (const auto &cell : removedCells) isReachable[cell.first][cell.second] = false;
+        _updateReachableStateInfo();
+    }
+    void update(const std::vector<std::pair<unsigned, unsigned> > &removedCells)
+    {
+        _updateReachableStateInfoIncremental(removedCells);
+    }
+};
+
+
+static std::vector<std::pair<unsigned, unsigned> > reachableCells(const std::vector<std::vector<bool> > &reachable)
+{
+    std::vector<std::pair<unsigned, unsigned> > cells;
+    for (unsigned i_fr=0; i_fr<reachable.size(); i_fr++)
+    {
+        for (unsigned i_st=0; i_st<reachable[i_fr].size(); i_st++)
+        {
+            if (reachable[i_fr][i_st]) cells.push_back(std::make_pair(i_fr, i_st));
+        }
+    }
+    return cells;
+}
+
+
+// Removes the cells (and restricts the frames of windowedNum states) in two estimators
+// prepared alike, one updated incrementally and the other by the full sweep.
+static void checkRemoval(TestChecker &checker, const DemoData &demo, double removedRatio, unsigned windowedNum,
+                         std::mt19937 &rng, const std::string &what)
+{
+    ReachabilityProbe incremental(demo.config), full(demo.config);
+    if (!checker.check(prepareDemo(incremental, demo, nullptr) == NO_ERROR
+                       && prepareDemo(full, demo, nullptr) == NO_ERROR, what + ": validate")) return;
+
+    std::vector<std::pair<unsigned, unsigned> > cells = reachableCells(incremental.getReachable());
+    std::shuffle(cells.begin(), cells.end(), rng);
+    cells.resize(std::max((std::size_t)1, (std::size_t)(cells.size() * removedRatio)));
+
+    unsigned frameNum = incremental.getFrameNum();
+    std::uniform_int_distribution<unsigned> state(0, incremental.getStateNum() - 1);
+    std::uniform_int_distribution<unsigned> frame(0, frameNum - 1);
+    for (unsigned i=0; i<windowedNum; i++)
+    {
+        unsigned i_st = state(rng);
+        unsigned begin = frame(rng);
+        unsigned end = std::min(begin + frameNum / 4, frameNum);
+        incremental.restrict(i_st, begin, end);
+        full.restrict(i_st, begin, end);
+    }
+
+    incremental.update(cells);
+    full.sweep(cells);
+    checker.check(incremental.getReachable() == full.getReachable(), what);
+}
+
+
+int main(int argc, char *argv[])
+{
+    TestChecker checker;
+    DemoData demo = loadDemoData(argc > 1 ? argv[1] : "demo");
+    std::mt19937 rng(1);
+
+    // Few cells: propagated frame by frame. Many: the full sweep as fallback.
+    for (unsigned trial=0; trial<5; trial++)
+    {
+        std::string suffix = " (trial " + std::to_string(trial) + ")";
+        checkRemoval(checker, demo, 1e-5, 0, rng, "few cells" + suffix);
+        checkRemoval(checker, demo, 1e-4, 3, rng, "few cells and windows" + suffix);
+    }
+    checkRemoval(checker, demo, 0.0, 10, rng, "windows only");
+    checkRemoval(checker, demo, 0.3, 3, rng, "many cells");
+
+    // The constraints of the demo: the result is kept by the full sweep.
+    std::vector<StochasticCommandConstraint> sccs = demoConstraints();
+    ReachabilityProbe constrained(demo.config);
+    if (checker.check(prepareDemo(constrained, demo, &sccs) == NO_ERROR, "constraints: validate"))
+    {
+        std::vector<std::vector<bool> > reachable = constrained.getReachable();
+        constrained.sweep({});
+        checker.check(reachable == constrained.getReachable(), "constraints: consistent");
+    }
+
+    return checker.result();
+}
@@ -0,0 +1,116 @@
+// Stitching of two chunk results at a cut: the phrase command the right chunk
+// places at its start is kept less the tail of the left chunk's phrase,
+// so that the stitched contour follows the right chunk's own in its core.
+
+#include <cmath>
+#include "segmentation.hpp"
+#include "error_codes.hpp"
+#include "check.hpp"
+
+using namespace stfmest;
+
+
+static const double fs = 100.0;
+static const unsigned frameNum = 1000;
+static const double mub = 4.5;
+static const double omegaPhrase = 3.0;
+
+
+static InputData voicedInput()
+{
+    InputData id_;
+    id_.fs = fs;
+    id_.logf0.assign(frameNum, mub);
+    id_.vuv.assign(frameNum, 1.0);
+    id_.initial_up.assign(frameNum, 0.0);
+    id_.initial_ua.assign(frameNum, 0.0);
+    id_.initial_mub = mub;
+    return id_;
+}
+
+
+static FujisakiCommand phraseAt(double onset, double integratedAmplitude)
+{
+    return FujisakiCommand(CMD_PHRASE, onset, onset + 0.04, integratedAmplitude, omegaPhrase);
+}
+
+
+// Least-squares amplitude of a phrase at onset to the response of the phrase at 0 in frames [begin, end)
+static double fittedTailAmplitude(double leftAmplitude, double onset, unsigned begin, unsigned end)
+{
+    std::vector<double> tail = criticalfilter(phraseAt(0.0, leftAmplitude), fs, frameNum);
+    std::vector<double> unit = criticalfilter(phraseAt(onset, 1.0), fs, frameNum);
+    double product = 0.0, norm2 = 0.0;
+    for (unsigned i=begin; i<end; i++)
+    {
+        product += tail[i] * unit[i];
+        norm2 += unit[i] * unit[i];
+    }
+    return product / norm2;
+}
+
+
+static double phraseAmplitudeAt(const EstimationResult &er, double onset)
+{
+    for (const auto &c : er.commands)
+    {
+        if (c.filtertype == CMD_PHRASE && std::abs(c.onset - onset) < 1e-9) return c.integratedAmplitude;
+    }
+    return 0.0;
+}
+
+
+int main()
+{
+    TestChecker checker;
+    InputData id_ = voicedInput();
+    SegmentationConfig sc;
+    std::vector<InputChunk> chunks{{0, 550, 0, 500}, {450, frameNum, 500, frameNum}};
+    double rightStart = chunks[1].frameBegin / fs;
+    std::vector<ChunkBoundaryReport> reports;
+
+    // The right chunk explains the tail of the left phrase, and a new phrase of 0.3, by its first phrase.
+    std::vector<EstimationResult> chunkResults(2);
+    double tailAmplitude = fittedTailAmplitude(0.8, rightStart, chunks[1].coreBegin, chunks[1].coreEnd);
+    chunkResults[0].mub = chunkResults[1].mub = mub;
+    chunkResults[0].commands = {phraseAt(0.0, 0.8)};
+    chunkResults[1].commands = {phraseAt(0.0, tailAmplitude + 0.3)}; // in the time of the chunk
+
+    int status = VALUE_INVALID;
+    EstimationResult er = stitchResults(id_, chunks, chunkResults, sc, 1e-5, reports, &status);
+    checker.check(status == NO_ERROR, "status");
+    checker.check(er.commands.size() == 2, "both phrases kept");
+    checker.check(std::abs(phraseAmplitudeAt(er, rightStart) - 0.3) < 1e-9, "tail subtracted from the right phrase");
+    checker.check(reports.size() == 1 && std::abs(reports[0].subtractedPhraseAmplitude - tailAmplitude) < 1e-9,
+                  "subtracted amplitude reported");
+
+    // The stitched contour in the right core is closer to the right chunk's own than without its phrase.
+    std::vector<double> rightContour = criticalfilter({phraseAt(rightStart, tailAmplitude + 0.3)}, mub, fs, frameNum);
+    std::vector<double> withoutPhrase = criticalfilter({phraseAt(0.0, 0.8)}, mub, fs, frameNum);
+    double stitchedError = 0.0, droppedError = 0.0;
+    for (unsigned i=chunks[1].coreBegin; i<chunks[1].coreEnd; i++)
+    {
+        stitchedError += (er.regeneratedlf0[i] - rightContour[i]) * (er.regeneratedlf0[i] - rightContour[i]);
+        droppedError += (withoutPhrase[i] - rightContour[i]) * (withoutPhrase[i] - rightContour[i]);
+    }
+    checker.check(stitchedError < 0.1 * droppedError, "stitched contour in the right core");
+
+    // A phrase the right chunk found before the cut together with the left chunk is kept once, from the left.
+    chunkResults[0].commands = {phraseAt(0.0, 0.8), phraseAt(4.7, 0.5)};
+    chunkResults[1].commands = {phraseAt(4.72 - rightStart, 0.6)};
+    er = stitchResults(id_, chunks, chunkResults, sc, 1e-5, reports, &status);
+    checker.check(status == NO_ERROR && er.commands.size() == 2, "matched phrase kept once");
+    checker.check(std::abs(phraseAmplitudeAt(er, 4.7) - 0.5) < 1e-9, "left phrase kept");
+
+    // The report has the same keys with nothing to compare in the overlap.
+    nlohmann::json emptyReport = ChunkBoundaryReport();
+    checker.check(emptyReport.count("coincidence") && emptyReport["coincidence"].is_array()
+                  && emptyReport["coincidence"].empty(), "empty coincidence in the report");
+
+    // An invalid command fails the synthesis of the stitched contour.
+    chunkResults[1].commands = {FujisakiCommand(CMD_ACCENT, 1.0, 0.9, 0.3, 20.0)};
+    stitchResults(id_, chunks, chunkResults, sc, 1e-5, reports, &status);
+    checker.check(status == VALUE_INVALID, "invalid command reported");
+
+    return checker.result();
+}
@@ -21,6 +21,7 @@ namespace stfmest
         // EM algorithm preferences
         bool isHardEmEnabled = true;
         int iterationNum;
+        int warmStartIterationNum = -1; // (Optional) iterationNum when started from a previous result. Negative: same as iterationNum.
         int mstepUpdateNumPerIteration;
         int perturbSearchWidth;
 
@@ -47,6 +48,7 @@ namespace stfmest
                            {"durationExtensionFactor", ec.durationExtensionFactor},
                            {"isHardEmEnabled", ec.isHardEmEnabled},
                            {"iterationNum", ec.iterationNum},
+                           {"warmStartIterationNum", ec.warmStartIterationNum},
                            {"mstepUpdateNumPerIteration", ec.mstepUpdateNumPerIteration},
                            {"perturbSearchWidth", ec.perturbSearchWidth},
                            {"defaultAlpha", ec.defaultAlpha},
@@ -98,5 +100,9 @@ namespace stfmest
         {
             ec.durationExtensionFactor = j.at("durationExtensionFactor").get<double>();
         }
+        if (j.count("warmStartIterationNum"))
+        {
+            ec.warmStartIterationNum = j.at("warmStartIterationNum").get<int>();
+        }
     }
 }
\ No newline at end of file
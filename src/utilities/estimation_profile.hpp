@@ -0,0 +1,70 @@
+// Running time of each phase and operation counts of an estimation
+//
+// Times are in seconds by the steady clock.
+
+#pragma once
+#include <vector>
+#include "json.hpp"
+#include "memory_usage.hpp"
+
+
+namespace stfmest
+{
+    struct EstimationProfile
+    {
+        // emPreparation (accumulated if called more than once)
+        double initHmm = 0.0;
+        double initSmallStates = 0.0;
+        double reachability = 0.0; // _initReachableStateInfo & _updateReachableStateInfo
+        double initEm = 0.0; // EM parameters & variables
+        double constraints = 0.0; // e.g. imposeStochasticConst
+
+        // Each call in the EM iterations
+        std::vector<double> viterbiAlgorithm;
+        std::vector<double> hardMstep;
+        std::vector<double> perturbCommands;
+
+        double getResult = 0.0;
+
+        // Counters
+        unsigned long long statesVisited = 0; // (frame, small state) evaluated in the Viterbi algorithm
+        unsigned long long edgesRelaxed = 0;
+        unsigned long long perturbationCandidates = 0; // shifted commands scored in _perturbCommands
+
+        MemoryUsage memory; // at the end, with the peak
+    };
+
+
+    inline void to_json(nlohmann::json &j, const EstimationProfile &ep)
+    {
+        j = nlohmann::json{{"initHmm", ep.initHmm}, {"initSmallStates", ep.initSmallStates},
+                        {"reachability", ep.reachability}, {"initEm", ep.initEm},
+                        {"constraints", ep.constraints},
+                        {"viterbiAlgorithm", ep.viterbiAlgorithm}, {"hardMstep", ep.hardMstep},
+                        {"perturbCommands", ep.perturbCommands}, {"getResult", ep.getResult},
+                        {"statesVisited", ep.statesVisited}, {"edgesRelaxed", ep.edgesRelaxed},
+                        {"perturbationCandidates", ep.perturbationCandidates},
+                        {"memory", ep.memory}};
+    }
+
+
+    inline void from_json(const nlohmann::json &j, EstimationProfile &ep)
+    {
+        ep.initHmm = j.at("initHmm").get<double>();
+        ep.initSmallStates = j.at("initSmallStates").get<double>();
+        ep.reachability = j.at("reachability").get<double>();
+        ep.initEm = j.at("initEm").get<double>();
+        ep.constraints = j.at("constraints").get<double>();
+        ep.viterbiAlgorithm = j.at("viterbiAlgorithm").get<std::vector<double> >();
+        ep.hardMstep = j.at("hardMstep").get<std::vector<double> >();
+        ep.perturbCommands = j.at("perturbCommands").get<std::vector<double> >();
+        ep.getResult = j.at("getResult").get<double>();
+        ep.statesVisited = j.at("statesVisited").get<unsigned long long>();
+        ep.edgesRelaxed = j.at("edgesRelaxed").get<unsigned long long>();
+        ep.perturbationCandidates = j.at("perturbationCandidates").get<unsigned long long>();
+        if (j.count("memory"))
+        {
+            ep.memory = j.at("memory").get<MemoryUsage>();
+        }
+    }
+}
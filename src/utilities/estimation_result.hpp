@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include "json.hpp"
+#include "estimation_profile.hpp"
 
 
 namespace stfmest
@@ -13,19 +14,81 @@ namespace stfmest
         std::vector<double> Cp;
         std::vector<double> Ca;
         std::vector<int> bigs;
+        std::vector<double> up; // excitations at the end of EM, to warm-start from
+        std::vector<double> ua;
 
         std::vector<FujisakiCommand> commands;
+        double fs = 0.0; // frame rate [Hz] of the input and regeneratedlf0 (0: not given)
         std::vector<double> regeneratedlf0;
         double rmse;
         int voicedFrameNum;
+
+        bool hasProfile = false; // profile is output iff true
+        EstimationProfile profile;
     };
 
 
+    // A failed item in place of a result, as output by StatisticalFujisakiEst, its server
+    // and FujisakiSynth: {"error": message, "status": error code}. Check it before reading a result.
+    inline bool isErrorResult(const nlohmann::json &j)
+    {
+        return j.is_object() && j.count("error") > 0;
+    }
+
+
     inline void to_json(nlohmann::json &j, const EstimationResult &er)
     {
         j = nlohmann::json{{"mup", er.mup}, {"mua", er.mua}, {"mub", er.mub},
-                        {"Cp", er.Cp}, {"Ca", er.Ca}, {"bigs", er.bigs},
-                        {"commands", er.commands}, {"regeneratedlf0", er.regeneratedlf0},
+                        {"Cp", er.Cp}, {"Ca", er.Ca}, {"bigs", er.bigs}, {"up", er.up}, {"ua", er.ua},
+                        {"commands", er.commands}, {"fs", er.fs}, {"regeneratedlf0", er.regeneratedlf0},
                         {"rmse", er.rmse}, {"voicedFrameNum", er.voicedFrameNum}};
+        if (er.hasProfile) j["profile"] = er.profile;
+    }
+
+
+    inline void from_json(const nlohmann::json &j, EstimationResult &er)
+    {
+        er.mub = j.at("mub").get<double>();
+        er.commands = j.at("commands").get<std::vector<FujisakiCommand> >();
+        if (j.count("mup") && j.count("mua"))
+        {
+            er.mup = j.at("mup").get<std::vector<double> >();
+            er.mua = j.at("mua").get<std::vector<double> >();
+        }
+        if (j.count("Cp") && j.count("Ca"))
+        {
+            er.Cp = j.at("Cp").get<std::vector<double> >();
+            er.Ca = j.at("Ca").get<std::vector<double> >();
+        }
+        if (j.count("bigs"))
+        {
+            er.bigs = j.at("bigs").get<std::vector<int> >();
+        }
+        if (j.count("up") && j.count("ua"))
+        {
+            er.up = j.at("up").get<std::vector<double> >();
+            er.ua = j.at("ua").get<std::vector<double> >();
+        }
+        if (j.count("fs"))
+        {
+            er.fs = j.at("fs").get<double>();
+        }
+        if (j.count("regeneratedlf0"))
+        {
+            er.regeneratedlf0 = j.at("regeneratedlf0").get<std::vector<double> >();
+        }
+        if (j.count("rmse"))
+        {
+            er.rmse = j.at("rmse").get<double>();
+        }
+        if (j.count("voicedFrameNum"))
+        {
+            er.voicedFrameNum = j.at("voicedFrameNum").get<int>();
+        }
+        if (j.count("profile"))
+        {
+            er.profile = j.at("profile").get<EstimationProfile>();
+            er.hasProfile = true;
+        }
     }
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 #include <string>
 #include <vector>
 #include "json.hpp"
@@ -17,6 +18,27 @@ namespace stfmest
         // bool isAdditionalBindingEnabled = false;
     };
 
+    // All the signals have the same No. of frames.
+    inline bool isInputLengthConsistent(const InputData &id_)
+    {
+        return id_.vuv.size() == id_.logf0.size()
+            && id_.initial_up.size() == id_.logf0.size()
+            && id_.initial_ua.size() == id_.logf0.size();
+    }
+
+    // Input signals in the caller's arrays of frameNum frames (e.g. given through the C API)
+    struct InputDataView
+    {
+        double fs;
+        std::size_t frameNum;
+        const float *logf0;
+        const float *vuv;
+        const float *initial_up;
+        const float *initial_ua;
+        double initial_mub;
+    };
+
+
     inline void to_json(nlohmann::json &j, const InputData &id_)
     {
         j = nlohmann::json{{"fs", id_.fs},
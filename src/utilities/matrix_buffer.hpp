@@ -0,0 +1,21 @@
+// Reusing the memory of large matrices between input signals.
+//
+// The matrices are std::vector<std::vector<T> > indexed by frame first.
+// Rows beyond the current frame No. are kept allocated for later inputs,
+// so the outer size may be larger than the frame No.
+
+#pragma once
+#include <cstddef>
+#include <vector>
+
+
+namespace stfmest
+{
+    // Fill the first 'rows' rows of mat with 'cols' elements of 'value'.
+    template <typename T>
+    inline void assignMatrix(std::vector<std::vector<T> > &mat, std::size_t rows, std::size_t cols, const T &value)
+    {
+        if (mat.size() < rows) mat.resize(rows);
+        for (std::size_t i=0; i<rows; i++) mat[i].assign(cols, value);
+    }
+}
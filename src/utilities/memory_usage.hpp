@@ -0,0 +1,70 @@
+// Memory accounting of the buffers of the estimation
+//
+// Sizes are the bytes reserved (capacity), not the bytes in use,
+// as the buffers keep their capacity for the next inputs.
+
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include "json.hpp"
+
+
+namespace stfmest
+{
+    template <typename T>
+    inline unsigned long long reservedBytes(const std::vector<T> &v)
+    {
+        return (unsigned long long)v.capacity() * sizeof(T);
+    }
+
+    inline unsigned long long reservedBytes(const std::vector<bool> &v)
+    {
+        return v.capacity() / 8;
+    }
+
+    template <typename T>
+    inline unsigned long long reservedBytes(const std::vector<std::vector<T> > &m)
+    {
+        unsigned long long bytes = (unsigned long long)m.capacity() * sizeof(std::vector<T>);
+        for (const auto &row : m) bytes += reservedBytes(row);
+        return bytes;
+    }
+
+    template <typename K, typename V>
+    inline unsigned long long reservedBytes(const std::map<K, V> &m)
+    {
+        return (unsigned long long)m.size() * (sizeof(std::pair<const K, V>) + 32); // approx. tree node size
+    }
+
+    template <typename K, typename V>
+    inline unsigned long long reservedBytes(const std::vector<std::map<K, V> > &v)
+    {
+        unsigned long long bytes = (unsigned long long)v.capacity() * sizeof(std::map<K, V>);
+        for (const auto &m : v) bytes += reservedBytes(m);
+        return bytes;
+    }
+
+
+    struct MemoryUsage
+    {
+        std::map<std::string, unsigned long long> bufferBytes; // of each major buffer
+        unsigned long long totalBytes = 0; // sum of bufferBytes
+        unsigned long long peakBytes = 0; // max. totalBytes while estimating the current input
+    };
+
+
+    inline void to_json(nlohmann::json &j, const MemoryUsage &mu)
+    {
+        j = nlohmann::json{{"bufferBytes", mu.bufferBytes}, {"totalBytes", mu.totalBytes},
+                        {"peakBytes", mu.peakBytes}};
+    }
+
+
+    inline void from_json(const nlohmann::json &j, MemoryUsage &mu)
+    {
+        mu.bufferBytes = j.at("bufferBytes").get<std::map<std::string, unsigned long long> >();
+        mu.totalBytes = j.at("totalBytes").get<unsigned long long>();
+        mu.peakBytes = j.at("peakBytes").get<unsigned long long>();
+    }
+}
@@ -0,0 +1,17 @@
+// Floating point type of the large arrays used in the EM algorithm.
+//
+// Viterbi scores, the lambda's and the filter kernels are stored
+// in this type. Build with STFMEST_SINGLE_PRECISION=ON to store them
+// in single precision; sums over frames are always accumulated in double.
+
+#pragma once
+
+
+namespace stfmest
+{
+#ifdef STFMEST_SINGLE_PRECISION
+    typedef float Real;
+#else
+    typedef double Real;
+#endif
+}
@@ -0,0 +1,79 @@
+// Scratch buffers reused during the EM iterations.
+//
+// Buffers are acquired in a stack-like manner and returned together
+// when the ScratchScope that was opened before them is closed.
+// Memory is allocated only when a buffer has to grow, which is counted
+// in debug builds to check that the pools stop growing after the first
+// iteration. tests/em_allocation_test.cpp counts all the heap allocations.
+
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+
+namespace stfmest
+{
+    template <typename T>
+    class ScratchPool
+    {
+    public:
+        // A buffer with n elements of value, and at least 'capacity' reserved.
+        // Valid until the enclosing ScratchScope is closed.
+        std::vector<T> &acquire(std::size_t n, const T &value = T(), std::size_t capacity = 0)
+        {
+            if (used == buffers.size())
+            {
+                buffers.push_back(std::vector<T>());
+#ifndef NDEBUG
+                ++growthNum;
+#endif
+            }
+            std::vector<T> &buffer = buffers[used++];
+            if (capacity < n) capacity = n;
+            if (buffer.capacity() < capacity)
+            {
+                buffer.reserve(capacity);
+#ifndef NDEBUG
+                ++growthNum;
+#endif
+            }
+            buffer.assign(n, value);
+            return buffer;
+        }
+
+        inline unsigned long long reservedBytes() const
+        {
+            unsigned long long bytes = 0;
+            for (const auto &buffer : buffers) bytes += (unsigned long long)buffer.capacity() * sizeof(T);
+            return bytes;
+        }
+
+        inline std::size_t mark() const { return used; }
+        inline void release(std::size_t mark_) { used = mark_; }
+
+#ifndef NDEBUG
+        inline std::size_t getGrowthNum() const { return growthNum; } // No. of allocations so far
+#endif
+
+    private:
+        std::deque<std::vector<T> > buffers; // deque: acquired references stay valid
+        std::size_t used = 0;
+#ifndef NDEBUG
+        std::size_t growthNum = 0;
+#endif
+    };
+
+
+    // Returns the buffers acquired in its lifetime to the pool.
+    template <typename T>
+    class ScratchScope
+    {
+    public:
+        ScratchScope(ScratchPool<T> &pool): pool(pool), mark(pool.mark()) {}
+        ~ScratchScope() { pool.release(mark); }
+    private:
+        ScratchPool<T> &pool;
+        std::size_t mark;
+    };
+}
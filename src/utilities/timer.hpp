@@ -18,12 +18,12 @@ namespace stfmest
 
         inline void start()
         {
-            starttime = std::chrono::system_clock::now();
+            starttime = std::chrono::steady_clock::now();
         }
 
         inline double stop()
         {
-            auto endtime = std::chrono::system_clock::now();
+            auto endtime = std::chrono::steady_clock::now();
             duration_sec = endtime - starttime;
             return duration_sec.count();
         }
@@ -32,14 +32,14 @@ namespace stfmest
 
         inline double lap()
         {
-            auto endtime = std::chrono::system_clock::now();
+            auto endtime = std::chrono::steady_clock::now();
             duration_sec = endtime - starttime;
             starttime = endtime;
             return duration_sec.count();
         }
 
     private:
-        std::chrono::system_clock::time_point starttime;
+        std::chrono::steady_clock::time_point starttime;
         std::chrono::duration<double> duration_sec;
     };
 }
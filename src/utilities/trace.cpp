@@ -0,0 +1,75 @@
+#include <fstream>
+#include "json.hpp"
+#include "trace.hpp"
+
+
+namespace stfmest
+{
+    TraceCollector &TraceCollector::instance()
+    {
+        static TraceCollector collector;
+        return collector;
+    }
+
+
+    TraceCollector::ThreadBuffer &TraceCollector::_threadBuffer()
+    {
+        static thread_local ThreadBuffer *buffer = nullptr;
+        if (buffer == nullptr)
+        {
+            std::lock_guard<std::mutex> lock(bufferMutex);
+            buffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+            buffer = buffers.back().get();
+            buffer->tid = buffers.size();
+            buffer->name = "thread " + std::to_string(buffer->tid);
+        }
+        return *buffer;
+    }
+
+
+    void TraceCollector::record(const std::string &name, TimePoint begin, TimePoint end)
+    {
+        using std::chrono::duration_cast;
+        using std::chrono::microseconds;
+        TraceEvent ev;
+        ev.name = name;
+        ev.beginUs = duration_cast<microseconds>(begin - origin).count();
+        ev.durationUs = duration_cast<microseconds>(end - begin).count();
+        _threadBuffer().events.push_back(ev);
+    }
+
+
+    void TraceCollector::setThreadName(const std::string &name)
+    {
+        _threadBuffer().name = name;
+    }
+
+
+    bool TraceCollector::write(const std::string &filename)
+    {
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        std::ofstream ofs(filename);
+        if (!ofs) return false;
+
+        // Written event by event, as a trace may be large.
+        ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool isFirst = true;
+        auto put = [&](const nlohmann::json &j)
+        {
+            ofs << (isFirst ? "\n" : ",\n") << j.dump();
+            isFirst = false;
+        };
+        for (const auto &buffer : buffers)
+        {
+            put(nlohmann::json{{"name", "thread_name"}, {"ph", "M"}, {"pid", 1}, {"tid", buffer->tid},
+                               {"args", {{"name", buffer->name}}}});
+            for (const auto &ev : buffer->events)
+            {
+                put(nlohmann::json{{"name", ev.name}, {"cat", "stfmest"}, {"ph", "X"}, {"pid", 1},
+                                   {"tid", buffer->tid}, {"ts", ev.beginUs}, {"dur", ev.durationUs}});
+            }
+        }
+        ofs << "\n]}" << std::endl;
+        return (bool)ofs;
+    }
+}
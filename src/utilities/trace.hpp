@@ -0,0 +1,99 @@
+// Scoped tracing in the Chrome trace event format
+//
+// STFMEST_TRACE_SCOPE(name) records a span from the line to the end of
+// the scope on the calling thread while the collector is enabled.
+// The macros are removed unless STFMEST_ENABLE_TRACE is defined
+// (CMake option of the same name); then the name is not even evaluated.
+// The written file can be viewed by chrome://tracing or Perfetto.
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace stfmest
+{
+    class TraceCollector
+    {
+    public:
+        typedef std::chrono::steady_clock::time_point TimePoint;
+
+        static TraceCollector &instance();
+
+        inline void enable(bool enable_) { isEnabled = enable_; }
+        inline bool enabled() const { return isEnabled; }
+
+        void record(const std::string &name, TimePoint begin, TimePoint end);
+        void setThreadName(const std::string &name); // of the calling thread
+
+        // Call after all the traced threads finished. false if the file cannot be written.
+        bool write(const std::string &filename);
+
+    private:
+        struct TraceEvent
+        {
+            std::string name;
+            long long beginUs; // from origin
+            long long durationUs;
+        };
+
+        // Events of one thread, appended without locking
+        struct ThreadBuffer
+        {
+            unsigned tid;
+            std::string name;
+            std::vector<TraceEvent> events;
+        };
+
+        TraceCollector(): origin(std::chrono::steady_clock::now()) {}
+        ThreadBuffer &_threadBuffer();
+
+        std::atomic<bool> isEnabled{false};
+        TimePoint origin;
+        std::mutex bufferMutex; // for buffers
+        std::vector<std::unique_ptr<ThreadBuffer> > buffers;
+    };
+
+
+    class TraceScope
+    {
+    public:
+        // The name is copied only while enabled, so that a disabled scope does not allocate.
+        explicit TraceScope(const char *name_): isActive(TraceCollector::instance().enabled())
+        {
+            if (isActive)
+            {
+                name = name_;
+                begin = std::chrono::steady_clock::now();
+            }
+        }
+
+        explicit TraceScope(const std::string &name_): TraceScope(name_.c_str()) {}
+
+        ~TraceScope()
+        {
+            if (isActive) TraceCollector::instance().record(name, begin, std::chrono::steady_clock::now());
+        }
+
+    private:
+        bool isActive;
+        std::string name;
+        TraceCollector::TimePoint begin;
+    };
+}
+
+
+#ifdef STFMEST_ENABLE_TRACE
+#define STFMEST_TRACE_CONCAT_(a, b) a##b
+#define STFMEST_TRACE_CONCAT(a, b) STFMEST_TRACE_CONCAT_(a, b)
+#define STFMEST_TRACE_SCOPE(name) stfmest::TraceScope STFMEST_TRACE_CONCAT(stfmestTraceScope_, __LINE__)(name)
+#define STFMEST_TRACE_THREAD_NAME(name) stfmest::TraceCollector::instance().setThreadName(name)
+#else
+// The names are not evaluated, but their variables still count as used.
+#define STFMEST_TRACE_SCOPE(name) ((void)sizeof(name))
+#define STFMEST_TRACE_THREAD_NAME(name) ((void)sizeof(name))
+#endif